@@ -0,0 +1,271 @@
+/**
+ * Frustrum culling microbenchmark
+ *
+ * Builds a large grid of chunk boxes around a camera and culls them three ways: the chunk quadtree, one flat batched
+ * BoxCullList test and a plain one box at a time test. Checks that all agree and prints the time per cull of the grid,
+ * also after half of the chunks were removed from the quadtree and inserted again.
+ * Then runs the frustrum visible chunks through the occlusion rasterizer with a ridge in front of the camera, and
+ * checks with ray casts that every chunk it hides really is behind the occluders.
+ *
+ * build from the repository root:
+ *   clang++ -std=c++17 -O2 -DGLFW_INCLUDE_NONE -Idependencies/include bench/culling_bench.cpp -o culling_bench
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "../headers/frustrum.h"
+#include "../headers/frustrum_culling.h"
+#include "../headers/chunk_quadtree.h"
+#include "../headers/occlusion_culling.h"
+
+using namespace std;
+
+// the box at a time test the batch is compared against
+bool isBoxInFrustrum(const Frustrum &frustrum, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+{
+    const Plane *planes[6] = {&frustrum.frontFace, &frustrum.rearFace, &frustrum.leftFace,
+                              &frustrum.rightFace, &frustrum.topFace, &frustrum.bottomFace};
+    for (int i = 0; i < 6; i++)
+    {
+        const glm::vec3 &normal = planes[i]->normal;
+        glm::vec3 corner(normal.x >= 0.0f ? boxMax.x : boxMin.x,
+                         normal.y >= 0.0f ? boxMax.y : boxMin.y,
+                         normal.z >= 0.0f ? boxMax.z : boxMin.z);
+        if (glm::dot(normal, corner) + planes[i]->distance < 0.0f)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+// whether the segment from start to end passes through the box, slab test
+bool segmentHitsBox(const glm::vec3 &start, const glm::vec3 &end, const OcclusionBox &box)
+{
+    float enter = 0.0f, leave = 1.0f;
+    for (int axis = 0; axis < 3; axis++)
+    {
+        float direction = end[axis] - start[axis];
+        if (std::fabs(direction) < 1e-6f)
+        {
+            if (start[axis] < box.boxMin[axis] || start[axis] > box.boxMax[axis])
+            {
+                return false;
+            }
+            continue;
+        }
+        float t0 = (box.boxMin[axis] - start[axis]) / direction;
+        float t1 = (box.boxMax[axis] - start[axis]) / direction;
+        enter = std::max(enter, std::min(t0, t1));
+        leave = std::min(leave, std::max(t0, t1));
+    }
+    return enter <= leave;
+}
+
+// every point of a grid over the box must have an occluder between it and the camera
+bool isBoxHidden(const OcclusionBox &box, const glm::vec3 &camera, const std::vector<OcclusionBox> &occluders)
+{
+    const int samples = 5;
+    for (int i = 0; i < samples * samples * samples; i++)
+    {
+        glm::vec3 t(i % samples, i / samples % samples, i / (samples * samples));
+        glm::vec3 point = box.boxMin + (box.boxMax - box.boxMin) * t / (float)(samples - 1);
+        bool hidden = false;
+        for (const auto &occluder : occluders)
+        {
+            if (segmentHitsBox(point, camera, occluder))
+            {
+                hidden = true;
+                break;
+            }
+        }
+        if (!hidden)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+int main()
+{
+    // 128 x 128 chunks around the camera
+    const int gridRadius = 64;
+    const int chunkSize = 16;
+    BoxCullList boxes;
+    ChunkQuadtree tree;
+    std::vector<QuadtreeHandle> handles;
+    std::vector<glm::vec3> boxMins, boxMaxs;
+    for (int x = -gridRadius; x < gridRadius; x++)
+    {
+        for (int z = -gridRadius; z < gridRadius; z++)
+        {
+            glm::vec3 boxMin(x * chunkSize - 0.5f, -0.5f, z * chunkSize - 0.5f);
+            glm::vec3 boxMax = boxMin + glm::vec3(chunkSize, 24.0f + (x ^ z) % 8, chunkSize);
+            handles.push_back(tree.insert((int)boxes.size(), x, z, boxMin, boxMax));
+            boxes.add(boxMin, boxMax);
+            boxMins.push_back(boxMin);
+            boxMaxs.push_back(boxMax);
+        }
+    }
+
+    glm::mat4 projection = glm::perspective(glm::radians(45.0f), 800.0f / 600.0f, 0.1f, 400.0f);
+    glm::mat4 view = glm::lookAt(glm::vec3(8.0f, 20.0f, 8.0f), glm::vec3(40.0f, 10.0f, -30.0f), glm::vec3(0.0f, 1.0f, 0.0f));
+    Frustrum frustrum = Frustrum::fromViewProjection(projection * view);
+    FrustrumPlanes planes(frustrum);
+
+    std::vector<uint8_t> visible(boxes.paddedSize());
+    const int iterations = 2000;
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        boxes.cull(planes, visible.data());
+    }
+    std::chrono::duration<double, std::micro> batchTime = std::chrono::steady_clock::now() - start;
+
+    std::vector<int> treeVisible;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        treeVisible.clear();
+        tree.cull(planes, treeVisible);
+    }
+    std::chrono::duration<double, std::micro> treeTime = std::chrono::steady_clock::now() - start;
+
+    size_t scalarVisible = 0;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < iterations; i++)
+    {
+        scalarVisible = 0;
+        for (size_t box = 0; box < boxMins.size(); box++)
+        {
+            scalarVisible += isBoxInFrustrum(frustrum, boxMins[box], boxMaxs[box]);
+        }
+    }
+    std::chrono::duration<double, std::micro> scalarTime = std::chrono::steady_clock::now() - start;
+
+    size_t batchVisible = 0, mismatches = 0;
+    for (size_t box = 0; box < boxMins.size(); box++)
+    {
+        batchVisible += visible[box];
+        mismatches += visible[box] != isBoxInFrustrum(frustrum, boxMins[box], boxMaxs[box]);
+    }
+
+    std::vector<uint8_t> inTree(boxMins.size(), 0);
+    for (int id : treeVisible)
+    {
+        inTree[id] = 1;
+    }
+    for (size_t box = 0; box < boxMins.size(); box++)
+    {
+        mismatches += inTree[box] != visible[box];
+    }
+
+    // unload every other chunk column like the view distance does, the rest must still cull the same, then load them
+    // again into the freed places
+    size_t removedMismatches = 0;
+    for (size_t box = 0; box < boxMins.size(); box += 2)
+    {
+        tree.remove(handles[box]);
+    }
+    treeVisible.clear();
+    tree.cull(planes, treeVisible);
+    std::fill(inTree.begin(), inTree.end(), 0);
+    for (int id : treeVisible)
+    {
+        inTree[id] = 1;
+    }
+    for (size_t box = 0; box < boxMins.size(); box++)
+    {
+        removedMismatches += inTree[box] != (box % 2 == 1 && visible[box]);
+    }
+    for (size_t box = 0; box < boxMins.size(); box += 2)
+    {
+        int x = (int)(box / (2 * gridRadius)) - gridRadius, z = (int)(box % (2 * gridRadius)) - gridRadius;
+        handles[box] = tree.insert((int)box, x, z, boxMins[box], boxMaxs[box]);
+    }
+    treeVisible.clear();
+    tree.cull(planes, treeVisible);
+    std::fill(inTree.begin(), inTree.end(), 0);
+    for (int id : treeVisible)
+    {
+        inTree[id] = 1;
+    }
+    for (size_t box = 0; box < boxMins.size(); box++)
+    {
+        removedMismatches += inTree[box] != visible[box];
+    }
+    mismatches += removedMismatches;
+
+    // occlusion: solid ground up to y = 8 around the camera and a ridge up to y = 40 across the view
+    glm::vec3 cameraPosition(8.0f, 20.0f, 8.0f);
+    std::vector<OcclusionBox> occluders;
+    for (int x = -8; x < 8; x++)
+    {
+        for (int z = -8; z < 8; z++)
+        {
+            glm::vec3 cellMin(x * chunkSize - 0.5f, -0.5f, z * chunkSize - 0.5f);
+            occluders.push_back(OcclusionBox{cellMin, cellMin + glm::vec3(chunkSize, 8.0f, chunkSize)});
+        }
+    }
+    for (int x = -8; x < 12; x++)
+    {
+        glm::vec3 cellMin(x * chunkSize - 0.5f, -0.5f, -3 * chunkSize - 0.5f);
+        occluders.push_back(OcclusionBox{cellMin, cellMin + glm::vec3(chunkSize, 40.0f, chunkSize)});
+    }
+    std::vector<OcclusionBox> candidates;
+    for (int id : treeVisible)
+    {
+        candidates.push_back(OcclusionBox{boxMins[id], boxMaxs[id]});
+    }
+
+    OcclusionRasterizer rasterizer;
+    std::vector<uint8_t> unoccluded(candidates.size());
+    const int occlusionIterations = 200;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < occlusionIterations; i++)
+    {
+        rasterizer.clear(projection * view);
+        for (const auto &occluder : occluders)
+        {
+            rasterizer.drawOccluder(occluder);
+        }
+    }
+    std::chrono::duration<double, std::micro> rasterTime = std::chrono::steady_clock::now() - start;
+    start = std::chrono::steady_clock::now();
+    for (int i = 0; i < occlusionIterations; i++)
+    {
+        for (size_t box = 0; box < candidates.size(); box++)
+        {
+            unoccluded[box] = rasterizer.isBoxVisible(candidates[box]);
+        }
+    }
+    std::chrono::duration<double, std::micro> testTime = std::chrono::steady_clock::now() - start;
+
+    size_t occluded = 0, wronglyOccluded = 0;
+    for (size_t box = 0; box < candidates.size(); box++)
+    {
+        if (!unoccluded[box])
+        {
+            occluded++;
+            wronglyOccluded += !isBoxHidden(candidates[box], cameraPosition, occluders);
+        }
+    }
+
+    printf("chunk boxes:                %zu\n", boxes.size());
+    printf("visible:                    %zu (box at a time %zu)\n", batchVisible, scalarVisible);
+    printf("quadtree cull:           %10.2f us  (%d regions, %d chunks tested)\n", treeTime.count() / iterations, tree.nodesTested, tree.chunksTested);
+    printf("batched cull:            %10.2f us\n", batchTime.count() / iterations);
+    printf("box at a time cull:      %10.2f us\n", scalarTime.count() / iterations);
+    printf("mismatches:                 %zu (%zu after removing and reinserting chunks)\n", mismatches, removedMismatches);
+    printf("occluders rasterized:    %10.2f us  (%zu boxes)\n", rasterTime.count() / occlusionIterations, occluders.size());
+    printf("occlusion tests:         %10.2f us  (%zu of %zu chunks occluded)\n", testTime.count() / occlusionIterations, occluded, candidates.size());
+    printf("wrongly occluded:           %zu\n", wronglyOccluded);
+    return mismatches == 0 && wronglyOccluded == 0 ? 0 : 1;
+}
@@ -0,0 +1,402 @@
+/**
+ * Mesher microbenchmark
+ *
+ * Meshes the same chunks with the old hash based mesher and the binary bitmask mesher and prints the time per chunk.
+ * It also checks that both meshers agree on which blocks have a visible face, and counts heap allocations to check
+ * that meshing a chunk allocates nothing once the per thread scratch and output buffers are warmed up.
+ * The chunk face connectivity is checked against a block by block flood fill, on the terrain and on random caves.
+ * The coarse level of detail masks are checked to enclose every block, and the faces per level are counted.
+ * Allocations are also counted through the mesh cache and through the worker pool, the path the game meshes on.
+ *
+ * build from the repository root:
+ *   clang++ -std=c++17 -O2 -DGLFW_INCLUDE_NONE -Idependencies/include bench/mesher_bench.cpp -o mesher_bench
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <new>
+#include <cstdio>
+#include <set>
+#include <tuple>
+#include <deque>
+#include <filesystem>
+
+#include "../headers/chunk.h"
+#include "../headers/chunk_snapshot.h"
+#include "../headers/chunk_mesher.h"
+#include "../headers/binary_mesher.h"
+
+using namespace std;
+
+// counts every heap allocation made by the benchmark
+std::atomic<size_t> allocationCount{0};
+
+void *operator new(size_t size)
+{
+    allocationCount++;
+    void *memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr)
+    {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+// gcc cannot see that every new above comes from malloc, so it takes these frees for a mismatched pair
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpragmas"
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void operator delete(void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void *memory, size_t) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete[](void *memory, size_t) noexcept
+{
+    free(memory);
+}
+#pragma GCC diagnostic pop
+
+// block at a time flood fill through the open blocks of the chunk, the reference for computeChunkConnectivity
+ChunkConnectivity floodConnectivityByBlock(const BinaryMeshMasks &masks)
+{
+    const int size = Chunk::CHUNK_SIZE;
+    auto isOpen = [&](int x, int y, int z)
+    {
+        return ((masks.solidColumns[MESH_PADDING + x][MESH_PADDING + z] >> y) & 1) == 0;
+    };
+    auto facesOf = [&](int x, int y, int z)
+    {
+        return (z == 0) << FACE_NEG_Z | (z == size - 1) << FACE_POS_Z | (x == 0) << FACE_NEG_X |
+               (x == size - 1) << FACE_POS_X | (y == 0) << FACE_NEG_Y | (y == MESH_HEIGHT - 1) << FACE_POS_Y;
+    };
+    ChunkConnectivity connectivity;
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        std::vector<uint8_t> seen(size * size * MESH_HEIGHT, 0);
+        std::deque<std::tuple<int, int, int>> queue;
+        for (int x = 0; x < size; x++)
+        {
+            for (int y = 0; y < MESH_HEIGHT; y++)
+            {
+                for (int z = 0; z < size; z++)
+                {
+                    if ((facesOf(x, y, z) & (1 << face)) != 0 && isOpen(x, y, z))
+                    {
+                        seen[(x * size + z) * MESH_HEIGHT + y] = 1;
+                        queue.push_back(std::make_tuple(x, y, z));
+                    }
+                }
+            }
+        }
+        uint8_t faces = 0;
+        while (!queue.empty())
+        {
+            int x, y, z;
+            std::tie(x, y, z) = queue.front();
+            queue.pop_front();
+            faces |= facesOf(x, y, z);
+            const int offsets[6][3] = {{1, 0, 0}, {-1, 0, 0}, {0, 1, 0}, {0, -1, 0}, {0, 0, 1}, {0, 0, -1}};
+            for (const auto &offset : offsets)
+            {
+                int nx = x + offset[0], ny = y + offset[1], nz = z + offset[2];
+                if (nx < 0 || nx >= size || ny < 0 || ny >= MESH_HEIGHT || nz < 0 || nz >= size ||
+                    seen[(nx * size + nz) * MESH_HEIGHT + ny] || !isOpen(nx, ny, nz))
+                {
+                    continue;
+                }
+                seen[(nx * size + nz) * MESH_HEIGHT + ny] = 1;
+                queue.push_back(std::make_tuple(nx, ny, nz));
+            }
+        }
+        connectivity.faces[face] = faces;
+    }
+    return connectivity;
+}
+
+const int BENCH_RADIUS = 2;
+const int BENCH_ITERATIONS = 200;
+
+template <typename Function>
+double timePerChunk(const vector<ChunkSnapshot> &snapshots, Function function)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        for (const auto &snapshot : snapshots)
+        {
+            function(snapshot);
+        }
+    }
+    std::chrono::duration<double, std::micro> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / (BENCH_ITERATIONS * snapshots.size());
+}
+
+int main()
+{
+    // fixed seed so the trees are the same on every run
+    srand(1337);
+
+    ChunkMap chunks;
+    for (int x = -BENCH_RADIUS; x <= BENCH_RADIUS; x++)
+    {
+        for (int z = -BENCH_RADIUS; z <= BENCH_RADIUS; z++)
+        {
+            glm::vec3 origin(x * (float)Chunk::CHUNK_SIZE, 0.0f, z * (float)Chunk::CHUNK_SIZE);
+            chunks[origin] = std::make_shared<const Chunk>(origin);
+        }
+    }
+
+    // only chunks with all of their neighbours loaded are meshed
+    vector<ChunkSnapshot> snapshots;
+    for (int x = -BENCH_RADIUS + 1; x < BENCH_RADIUS; x++)
+    {
+        for (int z = -BENCH_RADIUS + 1; z < BENCH_RADIUS; z++)
+        {
+            snapshots.push_back(createChunkSnapshot(chunks, glm::vec3(x * (float)Chunk::CHUNK_SIZE, 0.0f, z * (float)Chunk::CHUNK_SIZE)));
+        }
+    }
+
+    // compare which blocks each mesher considers visible
+    size_t hashedInstances = 0, binaryQuads = 0, mismatches = 0;
+    std::unique_ptr<BinaryMeshScratch> scratch(new BinaryMeshScratch());
+    ChunkMeshData meshData;
+    for (const auto &snapshot : snapshots)
+    {
+        std::set<std::tuple<int, int, int, int>> hashedBlocks, binaryBlocks;
+
+        ChunkMeshData hashed = buildChunkMeshHashed(snapshot);
+        auto addHashedBlocks = [&](const std::vector<FaceInstance> &instances, const std::vector<MeshGroup> &groups)
+        {
+            for (const auto &group : groups)
+            {
+                // every exposed cube is in all 6 face groups, count it once
+                if (group.face != 0)
+                {
+                    continue;
+                }
+                for (unsigned int i = group.first; i < group.first + group.count; i++)
+                {
+                    glm::ivec3 local = faceInstancePosition(instances[i]);
+                    hashedBlocks.insert(std::make_tuple(group.blockType, local.x, local.y, local.z));
+                    hashedInstances++;
+                }
+            }
+        };
+        addHashedBlocks(hashed.opaqueInstances, hashed.opaqueGroups);
+        addHashedBlocks(hashed.transparentInstances, hashed.transparentGroups);
+
+        fillBinaryMeshMasks(snapshot, scratch->masks);
+        buildBinaryChunkQuads(*scratch);
+        binaryQuads += scratch->quads.size();
+        for (const auto &quad : scratch->quads)
+        {
+            for (int u = 0; u < quad.width; u++)
+            {
+                for (int v = 0; v < quad.height; v++)
+                {
+                    int x = quad.x, y = quad.y, z = quad.z;
+                    if (quad.face == FACE_NEG_Z || quad.face == FACE_POS_Z)
+                    {
+                        x += u;
+                        y += v;
+                    }
+                    else if (quad.face == FACE_NEG_X || quad.face == FACE_POS_X)
+                    {
+                        z += u;
+                        y += v;
+                    }
+                    else
+                    {
+                        x += u;
+                        z += v;
+                    }
+                    binaryBlocks.insert(std::make_tuple(quad.blockType, x, y, z));
+                }
+            }
+        }
+
+        for (const auto &block : hashedBlocks)
+        {
+            mismatches += binaryBlocks.count(block) == 0;
+        }
+        for (const auto &block : binaryBlocks)
+        {
+            mismatches += hashedBlocks.count(block) == 0;
+        }
+    }
+
+    // connectivity of the terrain chunks and of random caves, where about half the blocks are solid
+    size_t connectivityMismatches = 0;
+    std::unique_ptr<BinaryMeshMasks> caves(new BinaryMeshMasks());
+    for (int i = 0; i < 20; i++)
+    {
+        for (int x = 0; x < MESH_AREA; x++)
+        {
+            for (int z = 0; z < MESH_AREA; z++)
+            {
+                caves->solidColumns[x][z] = ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ (uint64_t)rand();
+                // the later ones get denser so some faces end up cut off from each other
+                for (int extra = 0; extra < i / 5; extra++)
+                {
+                    caves->solidColumns[x][z] |= ((uint64_t)rand() << 40) ^ ((uint64_t)rand() << 20) ^ (uint64_t)rand();
+                }
+            }
+        }
+        ChunkConnectivity fast = computeChunkConnectivity(*caves), reference = floodConnectivityByBlock(*caves);
+        connectivityMismatches += memcmp(fast.faces, reference.faces, sizeof(fast.faces)) != 0;
+    }
+    for (const auto &snapshot : snapshots)
+    {
+        fillBinaryMeshMasks(snapshot, scratch->masks);
+        ChunkConnectivity fast = computeChunkConnectivity(scratch->masks), reference = floodConnectivityByBlock(scratch->masks);
+        connectivityMismatches += memcmp(fast.faces, reference.faces, sizeof(fast.faces)) != 0;
+    }
+
+    // every block must lie in an occupied cell at every level, or the skirts would leave gaps next to finer chunks
+    size_t lodInstances[MESH_LOD_COUNT] = {}, lodEnclosureMisses = 0;
+    for (const auto &snapshot : snapshots)
+    {
+        for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+        {
+            ChunkSnapshot lodSnapshot = snapshot;
+            lodSnapshot.lod = lod;
+            buildChunkMesh(lodSnapshot, *scratch, meshData);
+            lodInstances[lod] += meshData.opaqueInstances.size() + meshData.transparentInstances.size();
+            if (lod == 0)
+            {
+                continue;
+            }
+            fillBinaryMeshMasks(snapshot, scratch->masks);
+            downsampleMeshMasks(scratch->masks, lod, scratch->lodMasks);
+            for (int x = 0; x < (int)Chunk::CHUNK_SIZE; x++)
+            {
+                for (int z = 0; z < (int)Chunk::CHUNK_SIZE; z++)
+                {
+                    uint64_t blocks = 0, cells = 0;
+                    for (int type = 0; type < BLOCK_TYPE_COUNT; type++)
+                    {
+                        blocks |= scratch->masks.ownColumns[type][MESH_PADDING + x][MESH_PADDING + z];
+                        cells |= scratch->lodMasks.ownColumns[type][MESH_PADDING + (x >> lod)][MESH_PADDING + (z >> lod)];
+                    }
+                    uint64_t covered = 0;
+                    for (; cells != 0; cells &= cells - 1)
+                    {
+                        covered |= bitRun(countTrailingZeros(cells) << lod, 1 << lod);
+                    }
+                    lodEnclosureMisses += __builtin_popcountll(blocks & ~covered);
+                }
+            }
+        }
+    }
+
+    double hashedTime = timePerChunk(snapshots, [](const ChunkSnapshot &snapshot)
+                                     { buildChunkMeshHashed(snapshot); });
+    double binaryTime = timePerChunk(snapshots, [&](const ChunkSnapshot &snapshot)
+                                     { fillBinaryMeshMasks(snapshot, scratch->masks);
+                                       buildBinaryChunkQuads(*scratch); });
+    // the face seeds are open on the terrain, so this is the cost of flooding the whole sky above a chunk
+    volatile uint8_t connectedFaces = 0;
+    double connectivityTime = timePerChunk(snapshots, [&](const ChunkSnapshot &snapshot)
+                                           { fillBinaryMeshMasks(snapshot, scratch->masks);
+                                             connectedFaces = computeChunkConnectivity(scratch->masks).faces[FACE_POS_Y]; });
+    double meshTime = timePerChunk(snapshots, [&](const ChunkSnapshot &snapshot)
+                                   { buildChunkMesh(snapshot, *scratch, meshData); });
+
+    // the scratch and output buffers have reached their working size, meshing must not allocate anymore
+    size_t allocationsBefore = allocationCount.load();
+    for (int i = 0; i < BENCH_ITERATIONS; i++)
+    {
+        for (const auto &snapshot : snapshots)
+        {
+            buildChunkMesh(snapshot, *scratch, meshData);
+        }
+    }
+    size_t steadyStateAllocations = allocationCount.load() - allocationsBefore;
+
+    // the game meshes through the disk cache: a round of misses that store every mesh, then a round of hits
+    const char *const cacheDirectory = "bench_mesh_cache";
+    std::filesystem::remove_all(cacheDirectory);
+    size_t cacheAllocations = 0, poolAllocations = 0;
+    {
+        MeshCache cache(cacheDirectory);
+        allocationsBefore = allocationCount.load();
+        for (int round = 0; round < 2; round++)
+        {
+            for (const auto &snapshot : snapshots)
+            {
+                buildChunkMesh(snapshot, *scratch, meshData, &cache);
+            }
+        }
+        cacheAllocations = allocationCount.load() - allocationsBefore;
+
+        // and on the worker threads, whose scratch and recycled meshes warm up with the first rounds. recycled meshes
+        // go to whichever chunk comes next, so the warm up ends after a few rounds in a row that allocate nothing
+        MeshWorkerPool pool(&cache);
+        ChunkMeshData result;
+        auto meshRound = [&]()
+        {
+            size_t before = allocationCount.load();
+            for (const auto &snapshot : snapshots)
+            {
+                pool.submit(snapshot);
+            }
+            for (size_t finished = 0; finished < snapshots.size();)
+            {
+                if (pool.tryPopResult(result))
+                {
+                    pool.recycle(std::move(result));
+                    finished++;
+                }
+                else
+                {
+                    std::this_thread::yield();
+                }
+            }
+            return allocationCount.load() - before;
+        };
+        for (int round = 0, quietRounds = 0; round < 1000 && quietRounds < 10; round++)
+        {
+            quietRounds = meshRound() == 0 ? quietRounds + 1 : 0;
+        }
+        for (int round = 0; round < 20; round++)
+        {
+            poolAllocations += meshRound();
+        }
+    }
+    std::filesystem::remove_all(cacheDirectory);
+
+    printf("chunks meshed:              %zu\n", snapshots.size());
+    printf("hash mesher:                %10.2f us/chunk  (%zu exposed cubes)\n", hashedTime, hashedInstances);
+    printf("binary mesher (quads only): %10.2f us/chunk  (%zu merged quads)\n", binaryTime, binaryQuads);
+    printf("binary mesher (instances):  %10.2f us/chunk\n", meshTime);
+    printf("masks + face connectivity:  %10.2f us/chunk\n", connectivityTime);
+    printf("speedup:                    %10.2fx\n", hashedTime / binaryTime);
+    printf("visible block mismatches:   %zu\n", mismatches);
+    printf("steady state allocations:   %zu\n", steadyStateAllocations);
+    printf("allocations with the cache: %zu\n", cacheAllocations);
+    printf("allocations in the pool:    %zu\n", poolAllocations);
+    printf("connectivity mismatches:    %zu\n", connectivityMismatches);
+    for (int lod = 0; lod < MESH_LOD_COUNT; lod++)
+    {
+        printf("level of detail %d (%dx):     %10.1f faces/chunk\n", lod, 1 << lod, (double)lodInstances[lod] / snapshots.size());
+    }
+    printf("blocks outside lod cells:   %zu\n", lodEnclosureMisses);
+    return mismatches == 0 && steadyStateAllocations == 0 && cacheAllocations == 0 && poolAllocations == 0 && connectivityMismatches == 0 && lodEnclosureMisses == 0 ? 0 : 1;
+}
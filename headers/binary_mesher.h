@@ -0,0 +1,662 @@
+#ifndef BINARY_MESHER_H
+#define BINARY_MESHER_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <cstring>
+#include <algorithm>
+
+#include "chunk.h"
+#include "chunk_snapshot.h"
+
+using namespace std;
+
+// face order matches the 6 vertex groups of the cube vertices in main.cpp
+const int FACE_NEG_Z = 0;
+const int FACE_POS_Z = 1;
+const int FACE_NEG_X = 2;
+const int FACE_POS_X = 3;
+const int FACE_NEG_Y = 4;
+const int FACE_POS_Y = 5;
+const int FACE_COUNT = 6;
+
+// one more than the highest block type in chunk.h
+const int BLOCK_TYPE_COUNT = WATER + 1;
+
+// merged rectangle of equal block faces, position is the minimum block relative to the chunk origin
+// width runs along the face's u axis and height along its v axis:
+//   +-Z faces: u = x, v = y    +-X faces: u = z, v = y    +-Y faces: u = x, v = z
+// ao holds the ambient occlusion level (0 = darkest, 3 = open) of the 4 corners, 2 bits per corner.
+// corner i is at u = i & 1, v = i >> 1 of the face
+struct MeshQuad
+{
+    int blockType;
+    int face;
+    int x, y, z;
+    int width, height;
+    int ao;
+};
+
+// all 4 corners unoccluded
+const int AO_OPEN = 0xFF;
+
+// when enabled faces next to blocks get per vertex ambient occlusion. such faces are kept at 1x1 so the greedy merge
+// only joins faces that are fully open
+const bool MESH_VERTEX_AO = true;
+
+// leaves reach 2 blocks into the neighbouring chunks, plus 1 block so their neighbours can be tested
+const int MESH_PADDING = 4;
+const int MESH_AREA = Chunk::CHUNK_SIZE + 2 * MESH_PADDING;
+// every column is one 64 bit mask with bit y set for an occupied block
+const int MESH_HEIGHT = 64;
+// resolutions a chunk can be meshed at, level l merges 2^l x 2^l x 2^l blocks into one cell
+const int MESH_LOD_COUNT = 4;
+
+// occupancy columns of the padded area around one chunk
+struct BinaryMeshMasks
+{
+    // blocks that belong to the meshed chunk, one set of columns per block type
+    uint64_t ownColumns[BLOCK_TYPE_COUNT][MESH_AREA][MESH_AREA];
+    // non transparent blocks of the meshed chunk and its neighbours, these hide the faces touching them
+    uint64_t solidColumns[MESH_AREA][MESH_AREA];
+};
+
+inline int countTrailingZeros(uint64_t value)
+{
+    return __builtin_ctzll(value);
+}
+
+inline int highestSetBit(uint64_t value)
+{
+    return 63 - __builtin_clzll(value);
+}
+
+// mask of `length` bits starting at bit `start`
+inline uint64_t bitRun(int start, int length)
+{
+    return (length >= 64 ? ~0ull : ((1ull << length) - 1)) << start;
+}
+
+void fillBinaryMeshMasks(const ChunkSnapshot &snapshot, BinaryMeshMasks &masks)
+{
+    memset(&masks, 0, sizeof(BinaryMeshMasks));
+
+    const int size = Chunk::CHUNK_SIZE;
+    const Chunk *center = snapshot.area[1][1].get();
+
+    // writes one block into the masks at padded coordinates. for hiding faces later writes replace earlier ones just like
+    // the old block map did, but every block of the meshed chunk keeps its own faces so trunks still show through their leaves
+    auto writeLocal = [&](int x, int y, int z, int blockType, bool isOwn)
+    {
+        if (blockType == AIR || blockType >= BLOCK_TYPE_COUNT)
+        {
+            return;
+        }
+        if (x < 0 || x >= MESH_AREA || z < 0 || z >= MESH_AREA || y < 0 || y >= MESH_HEIGHT)
+        {
+            return;
+        }
+        uint64_t bit = 1ull << y;
+        if (blockType == LEAF)
+        {
+            masks.solidColumns[x][z] &= ~bit;
+        }
+        else
+        {
+            masks.solidColumns[x][z] |= bit;
+        }
+        if (isOwn)
+        {
+            masks.ownColumns[blockType][x][z] |= bit;
+        }
+    };
+    auto writeBlock = [&](const Block &block, bool isOwn)
+    {
+        glm::vec3 local = block.blockPosition - snapshot.origin;
+        writeLocal((int)local.x + MESH_PADDING, (int)local.y, (int)local.z + MESH_PADDING, block.blockType, isOwn);
+    };
+
+    auto writeChunk = [&](const Chunk &chunk, int dx, int dz, bool isOwn)
+    {
+        // only the strip of the chunk that overlaps the padded area is read
+        int minX = dx < 0 ? size - MESH_PADDING : 0;
+        int maxX = dx > 0 ? MESH_PADDING : size;
+        int minZ = dz < 0 ? size - MESH_PADDING : 0;
+        int maxZ = dz > 0 ? MESH_PADDING : size;
+        if (chunk.blocks.size() == (size_t)(size * size * size))
+        {
+            for (int x = minX; x < maxX; x++)
+            {
+                for (int z = minZ; z < maxZ; z++)
+                {
+                    // the terrain blocks are stored in x, z, y order so their position follows from the index
+                    const Block *column = &chunk.blocks[(x * size * size) + (z * size)];
+                    for (int y = 0; y < size; y++)
+                    {
+                        writeLocal(x + dx * size + MESH_PADDING, y, z + dz * size + MESH_PADDING, column[y].blockType, isOwn);
+                    }
+                }
+            }
+        }
+        for (const auto &block : chunk.trees)
+        {
+            writeBlock(block, isOwn);
+        }
+        for (const auto &block : chunk.leaves)
+        {
+            writeBlock(block, isOwn);
+        }
+    };
+
+    // neighbours first so the meshed chunk wins on overlapping positions
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            const Chunk *chunk = snapshot.area[dx + 1][dz + 1].get();
+            if (chunk != nullptr && chunk != center)
+            {
+                writeChunk(*chunk, dx, dz, false);
+            }
+        }
+    }
+    if (center != nullptr)
+    {
+        writeChunk(*center, 0, 0, true);
+    }
+}
+
+// greedy merges the set bits of a slice. rows run along the quad's u axis and bits along its v axis,
+// every merged rectangle is reported through emit(u, v, width, height). the rows are consumed.
+template <typename EmitQuad>
+void greedyMergeSlice(uint64_t *rows, int rowCount, EmitQuad emit)
+{
+    for (int u = 0; u < rowCount; u++)
+    {
+        while (rows[u] != 0)
+        {
+            // first run of set bits in this row
+            int v = countTrailingZeros(rows[u]);
+            uint64_t shifted = rows[u] >> v;
+            int height = ~shifted == 0 ? 64 - v : countTrailingZeros(~shifted);
+            uint64_t run = bitRun(v, height);
+
+            // grow along u while the next rows contain the whole run
+            int width = 1;
+            while (u + width < rowCount && (rows[u + width] & run) == run)
+            {
+                rows[u + width] &= ~run;
+                width++;
+            }
+            rows[u] &= ~run;
+            emit(u, v, width, height);
+        }
+    }
+}
+
+inline bool isSolidAt(const BinaryMeshMasks &masks, int x, int y, int z)
+{
+    if (x < 0 || x >= MESH_AREA || z < 0 || z >= MESH_AREA || y < 0 || y >= MESH_HEIGHT)
+    {
+        return false;
+    }
+    return (masks.solidColumns[x][z] >> y) & 1;
+}
+
+// unit steps of the face's normal, u and v axes, see MeshQuad
+const int FACE_AXES[FACE_COUNT][3][3] = {
+    {{0, 0, -1}, {1, 0, 0}, {0, 1, 0}},
+    {{0, 0, 1}, {1, 0, 0}, {0, 1, 0}},
+    {{-1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+    {{1, 0, 0}, {0, 0, 1}, {0, 1, 0}},
+    {{0, -1, 0}, {1, 0, 0}, {0, 0, 1}},
+    {{0, 1, 0}, {1, 0, 0}, {0, 0, 1}},
+};
+
+// ambient occlusion levels of the 4 corners of one block face at padded coordinates, packed like MeshQuad::ao
+int faceAmbientOcclusion(const BinaryMeshMasks &masks, int face, int x, int y, int z)
+{
+    const int(&normal)[3] = FACE_AXES[face][0];
+    const int(&u)[3] = FACE_AXES[face][1];
+    const int(&v)[3] = FACE_AXES[face][2];
+    // the layer of blocks the face looks into
+    int fx = x + normal[0], fy = y + normal[1], fz = z + normal[2];
+
+    int ao = 0;
+    for (int corner = 0; corner < 4; corner++)
+    {
+        int su = (corner & 1) ? 1 : -1;
+        int sv = (corner & 2) ? 1 : -1;
+        bool side1 = isSolidAt(masks, fx + su * u[0], fy + su * u[1], fz + su * u[2]);
+        bool side2 = isSolidAt(masks, fx + sv * v[0], fy + sv * v[1], fz + sv * v[2]);
+        bool diagonal = isSolidAt(masks, fx + su * u[0] + sv * v[0], fy + su * u[1] + sv * v[1], fz + su * u[2] + sv * v[2]);
+        int level = (side1 && side2) ? 0 : 3 - (side1 + side2 + diagonal);
+        ao |= level << (corner * 2);
+    }
+    return ao;
+}
+
+// marks the faces whose front layer has a solid block in any of the 8 positions around the block in front of them,
+// only those can get darker corners
+void computeFaceOccluders(const BinaryMeshMasks &masks, uint64_t (&occluders)[FACE_COUNT][MESH_AREA][MESH_AREA])
+{
+    const auto &solid = masks.solidColumns;
+    auto spreadY = [](uint64_t column)
+    {
+        return column | (column << 1) | (column >> 1);
+    };
+    for (int x = 1; x < MESH_AREA - 1; x++)
+    {
+        for (int z = 1; z < MESH_AREA - 1; z++)
+        {
+            occluders[FACE_NEG_Z][x][z] = spreadY(solid[x - 1][z - 1] | solid[x][z - 1] | solid[x + 1][z - 1]);
+            occluders[FACE_POS_Z][x][z] = spreadY(solid[x - 1][z + 1] | solid[x][z + 1] | solid[x + 1][z + 1]);
+            occluders[FACE_NEG_X][x][z] = spreadY(solid[x - 1][z - 1] | solid[x - 1][z] | solid[x - 1][z + 1]);
+            occluders[FACE_POS_X][x][z] = spreadY(solid[x + 1][z - 1] | solid[x + 1][z] | solid[x + 1][z + 1]);
+            uint64_t around = 0;
+            for (int dx = -1; dx <= 1; dx++)
+            {
+                for (int dz = -1; dz <= 1; dz++)
+                {
+                    around |= solid[x + dx][z + dz];
+                }
+            }
+            // bit y of the shifted columns is the layer below or above y
+            occluders[FACE_NEG_Y][x][z] = around << 1;
+            occluders[FACE_POS_Y][x][z] = around >> 1;
+        }
+    }
+}
+
+// working memory of the binary mesher. every mesh worker owns one and reuses it for every chunk,
+// so meshing a chunk does not touch the heap once the quad buffer has grown to its working size
+struct BinaryMeshScratch
+{
+    BinaryMeshMasks masks;
+    // bits y of the visible faces of one column
+    uint64_t visible[FACE_COUNT][MESH_AREA][MESH_AREA];
+    // rows of one slice
+    uint64_t rows[MESH_AREA];
+    // +-Y faces are sliced per height, so their columns are transposed into per y rows of z bits
+    uint64_t horizontalRows[2][MESH_HEIGHT][MESH_AREA];
+    // bits y of faces that have a solid block somewhere around the block in front of them
+    uint64_t occluders[FACE_COUNT][MESH_AREA][MESH_AREA];
+    // cells of the chunk when it is meshed at a coarser level, see downsampleMeshMasks
+    BinaryMeshMasks lodMasks;
+    // output of the last meshed chunk
+    std::vector<MeshQuad> quads;
+
+    BinaryMeshScratch()
+    {
+        quads.reserve(4096);
+    }
+};
+
+// meshes masks into merged quads, the result is left in scratch.quads
+void buildBinaryChunkQuads(BinaryMeshScratch &scratch, const BinaryMeshMasks &masks)
+{
+    std::vector<MeshQuad> &quads = scratch.quads;
+    auto &visible = scratch.visible;
+    auto &rows = scratch.rows;
+    auto &horizontalRows = scratch.horizontalRows;
+    auto &occluders = scratch.occluders;
+    quads.clear();
+
+    if (MESH_VERTEX_AO)
+    {
+        computeFaceOccluders(masks, occluders);
+    }
+
+    for (int type = 0; type < BLOCK_TYPE_COUNT; type++)
+    {
+        // heights used by this block type, slices outside of them are skipped
+        uint64_t usedHeights = 0;
+        for (int x = 1; x < MESH_AREA - 1; x++)
+        {
+            for (int z = 1; z < MESH_AREA - 1; z++)
+            {
+                uint64_t column = masks.ownColumns[type][x][z];
+                usedHeights |= column;
+                // a face is visible when the block next to it does not hide it
+                visible[FACE_NEG_Z][x][z] = column & ~masks.solidColumns[x][z - 1];
+                visible[FACE_POS_Z][x][z] = column & ~masks.solidColumns[x][z + 1];
+                visible[FACE_NEG_X][x][z] = column & ~masks.solidColumns[x - 1][z];
+                visible[FACE_POS_X][x][z] = column & ~masks.solidColumns[x + 1][z];
+                visible[FACE_NEG_Y][x][z] = column & ~(masks.solidColumns[x][z] << 1);
+                visible[FACE_POS_Y][x][z] = column & ~(masks.solidColumns[x][z] >> 1);
+            }
+        }
+        if (usedHeights == 0)
+        {
+            continue;
+        }
+        int minY = countTrailingZeros(usedHeights);
+        int maxY = highestSetBit(usedHeights);
+
+        auto addQuad = [&](int face, int x, int y, int z, int width, int height, int ao = AO_OPEN)
+        {
+            MeshQuad quad;
+            quad.blockType = type;
+            quad.face = face;
+            quad.x = x - MESH_PADDING;
+            quad.y = y;
+            quad.z = z - MESH_PADDING;
+            quad.width = width;
+            quad.height = height;
+            quad.ao = ao;
+            quads.push_back(quad);
+        };
+
+        // faces that may be occluded are emitted one by one with their corner levels and kept out of the merge
+        if (MESH_VERTEX_AO)
+        {
+            for (int face = 0; face < FACE_COUNT; face++)
+            {
+                for (int x = 1; x < MESH_AREA - 1; x++)
+                {
+                    for (int z = 1; z < MESH_AREA - 1; z++)
+                    {
+                        uint64_t occluded = visible[face][x][z] & occluders[face][x][z];
+                        visible[face][x][z] &= ~occluded;
+                        while (occluded != 0)
+                        {
+                            int y = countTrailingZeros(occluded);
+                            occluded &= occluded - 1;
+                            addQuad(face, x, y, z, 1, 1, faceAmbientOcclusion(masks, face, x, y, z));
+                        }
+                    }
+                }
+            }
+        }
+
+        // +-Z faces: one slice per z, rows along x, bits along y
+        for (int face = FACE_NEG_Z; face <= FACE_POS_Z; face++)
+        {
+            for (int z = 1; z < MESH_AREA - 1; z++)
+            {
+                uint64_t sliceBits = 0;
+                for (int x = 0; x < MESH_AREA; x++)
+                {
+                    rows[x] = (x > 0 && x < MESH_AREA - 1) ? visible[face][x][z] : 0;
+                    sliceBits |= rows[x];
+                }
+                if (sliceBits == 0)
+                {
+                    continue;
+                }
+                greedyMergeSlice(rows, MESH_AREA, [&](int u, int v, int width, int height)
+                                 { addQuad(face, u, v, z, width, height); });
+            }
+        }
+
+        // +-X faces: one slice per x, rows along z, bits along y
+        for (int face = FACE_NEG_X; face <= FACE_POS_X; face++)
+        {
+            for (int x = 1; x < MESH_AREA - 1; x++)
+            {
+                uint64_t sliceBits = 0;
+                for (int z = 0; z < MESH_AREA; z++)
+                {
+                    rows[z] = (z > 0 && z < MESH_AREA - 1) ? visible[face][x][z] : 0;
+                    sliceBits |= rows[z];
+                }
+                if (sliceBits == 0)
+                {
+                    continue;
+                }
+                greedyMergeSlice(rows, MESH_AREA, [&](int u, int v, int width, int height)
+                                 { addQuad(face, x, v, u, width, height); });
+            }
+        }
+
+        // +-Y faces: transpose the columns into one slice per y, rows along x, bits along z
+        for (int side = 0; side < 2; side++)
+        {
+            memset(horizontalRows[side][minY], 0, (maxY - minY + 1) * sizeof(horizontalRows[side][minY]));
+        }
+        for (int x = 1; x < MESH_AREA - 1; x++)
+        {
+            for (int z = 1; z < MESH_AREA - 1; z++)
+            {
+                for (int side = 0; side < 2; side++)
+                {
+                    uint64_t column = visible[FACE_NEG_Y + side][x][z];
+                    while (column != 0)
+                    {
+                        int y = countTrailingZeros(column);
+                        column &= column - 1;
+                        horizontalRows[side][y][x] |= 1ull << z;
+                    }
+                }
+            }
+        }
+        for (int side = 0; side < 2; side++)
+        {
+            for (int y = minY; y <= maxY; y++)
+            {
+                greedyMergeSlice(horizontalRows[side][y], MESH_AREA, [&](int u, int v, int width, int height)
+                                 { addQuad(FACE_NEG_Y + side, u, y, v, width, height); });
+            }
+        }
+    }
+}
+
+void buildBinaryChunkQuads(BinaryMeshScratch &scratch)
+{
+    buildBinaryChunkQuads(scratch, scratch.masks);
+}
+
+// one bit per run of `scale` bits of column, set when any bit of the run is
+inline uint64_t downsampleColumn(uint64_t column, int scale)
+{
+    uint64_t result = 0;
+    for (int cell = 0; column != 0; cell++, column >>= scale)
+    {
+        if (column & bitRun(0, scale))
+        {
+            result |= 1ull << cell;
+        }
+    }
+    return result;
+}
+
+// masks of the chunk at level lod, one bit per cell of 2^lod blocks along every axis. the quads meshed from them are
+// in cell units, writeQuadInstances scales them back to blocks.
+// a cell is occupied when any of its blocks is, so the coarse surface encloses the full resolution one, and it takes
+// the type of its highest blocks so grass stays on top. ties go to the lower block type.
+// the neighbours are left out on purpose: a coarse chunk keeps all faces on its border, and those close the gaps
+// towards neighbours meshed at another level like skirts
+void downsampleMeshMasks(const BinaryMeshMasks &fine, int lod, BinaryMeshMasks &coarse)
+{
+    memset(&coarse, 0, sizeof(BinaryMeshMasks));
+    const int scale = 1 << lod;
+    const int cells = Chunk::CHUNK_SIZE >> lod;
+    for (int cx = 0; cx < cells; cx++)
+    {
+        for (int cz = 0; cz < cells; cz++)
+        {
+            // blocks of the cell's footprint per type, only the chunk itself without the leaves hanging out of it
+            uint64_t typeColumns[BLOCK_TYPE_COUNT] = {};
+            uint64_t occupied = 0;
+            for (int type = 0; type < BLOCK_TYPE_COUNT; type++)
+            {
+                for (int dx = 0; dx < scale; dx++)
+                {
+                    for (int dz = 0; dz < scale; dz++)
+                    {
+                        typeColumns[type] |= fine.ownColumns[type][MESH_PADDING + cx * scale + dx][MESH_PADDING + cz * scale + dz];
+                    }
+                }
+                occupied |= typeColumns[type];
+            }
+
+            uint64_t occupiedCells = downsampleColumn(occupied, scale);
+            while (occupiedCells != 0)
+            {
+                int cy = countTrailingZeros(occupiedCells);
+                occupiedCells &= occupiedCells - 1;
+                uint64_t cellBits = bitRun(cy * scale, scale);
+                int cellType = AIR, cellTop = -1;
+                for (int type = 0; type < BLOCK_TYPE_COUNT; type++)
+                {
+                    uint64_t bits = typeColumns[type] & cellBits;
+                    if (bits != 0 && highestSetBit(bits) > cellTop)
+                    {
+                        cellType = type;
+                        cellTop = highestSetBit(bits);
+                    }
+                }
+                uint64_t bit = 1ull << cy;
+                coarse.ownColumns[cellType][MESH_PADDING + cx][MESH_PADDING + cz] |= bit;
+                if (cellType != LEAF)
+                {
+                    coarse.solidColumns[MESH_PADDING + cx][MESH_PADDING + cz] |= bit;
+                }
+            }
+        }
+    }
+}
+
+// the occlusion culler uses the terrain that is solid all the way down as its occluders, summarised per cell of
+// SOLID_FLOOR_CELL x SOLID_FLOOR_CELL columns
+const int SOLID_FLOOR_CELL = 4;
+const int SOLID_FLOOR_CELLS = Chunk::CHUNK_SIZE / SOLID_FLOOR_CELL;
+
+// number of blocks from y = 0 up that are solid in every column of a cell, 0 when any column is open at the bottom
+void computeSolidFloorHeights(const BinaryMeshMasks &masks, uint8_t (&heights)[SOLID_FLOOR_CELLS][SOLID_FLOOR_CELLS])
+{
+    for (int cellX = 0; cellX < SOLID_FLOOR_CELLS; cellX++)
+    {
+        for (int cellZ = 0; cellZ < SOLID_FLOOR_CELLS; cellZ++)
+        {
+            int height = MESH_HEIGHT;
+            for (int x = 0; x < SOLID_FLOOR_CELL; x++)
+            {
+                for (int z = 0; z < SOLID_FLOOR_CELL; z++)
+                {
+                    uint64_t open = ~masks.solidColumns[MESH_PADDING + cellX * SOLID_FLOOR_CELL + x][MESH_PADDING + cellZ * SOLID_FLOOR_CELL + z];
+                    height = std::min(height, open == 0 ? MESH_HEIGHT : countTrailingZeros(open));
+                }
+            }
+            heights[cellX][cellZ] = (uint8_t)height;
+        }
+    }
+}
+
+// which faces of a chunk can see each other through the chunk's non solid blocks. bit b of faces[a] is set when an
+// open path leads from face a to face b, and bit a when face a has any open block at all
+struct ChunkConnectivity
+{
+    uint8_t faces[FACE_COUNT] = {0x3F, 0x3F, 0x3F, 0x3F, 0x3F, 0x3F};
+};
+
+// open blocks of the meshed chunk only, the padding is left out
+using ChunkColumns = uint64_t[Chunk::CHUNK_SIZE][Chunk::CHUNK_SIZE];
+
+// grows reached through the open blocks of the chunk until nothing changes and returns the faces the flood touches.
+// columns are flooded a whole 64 bit column at a time, sweeping back and forth so long tunnels converge quickly
+uint8_t floodOpenColumns(const BinaryMeshMasks &masks, ChunkColumns &reached)
+{
+    const int size = Chunk::CHUNK_SIZE;
+    bool changed = true;
+    for (int pass = 0; changed; pass++)
+    {
+        changed = false;
+        for (int i = 0; i < size * size; i++)
+        {
+            int index = pass % 2 == 0 ? i : size * size - 1 - i;
+            int x = index / size, z = index % size;
+            uint64_t open = ~masks.solidColumns[MESH_PADDING + x][MESH_PADDING + z];
+            uint64_t grown = reached[x][z];
+            if (x > 0)
+            {
+                grown |= reached[x - 1][z];
+            }
+            if (x < size - 1)
+            {
+                grown |= reached[x + 1][z];
+            }
+            if (z > 0)
+            {
+                grown |= reached[x][z - 1];
+            }
+            if (z < size - 1)
+            {
+                grown |= reached[x][z + 1];
+            }
+            grown &= open;
+            // spread along the column until the run between solid blocks is filled
+            for (uint64_t previous = 0; grown != previous;)
+            {
+                previous = grown;
+                grown |= ((grown << 1) | (grown >> 1)) & open;
+            }
+            if (grown != reached[x][z])
+            {
+                reached[x][z] = grown;
+                changed = true;
+            }
+        }
+    }
+
+    uint8_t faces = 0;
+    for (int i = 0; i < size; i++)
+    {
+        faces |= (reached[i][0] != 0) << FACE_NEG_Z;
+        faces |= (reached[i][size - 1] != 0) << FACE_POS_Z;
+        faces |= (reached[0][i] != 0) << FACE_NEG_X;
+        faces |= (reached[size - 1][i] != 0) << FACE_POS_X;
+        for (int j = 0; j < size; j++)
+        {
+            faces |= (reached[i][j] & 1) << FACE_NEG_Y;
+            faces |= (reached[i][j] >> (MESH_HEIGHT - 1)) << FACE_POS_Y;
+        }
+    }
+    return faces;
+}
+
+// faces reachable from the open block at x, y, z of the chunk, 0 when the block is solid
+uint8_t openFacesFromBlock(const BinaryMeshMasks &masks, int x, int y, int z)
+{
+    ChunkColumns reached = {};
+    reached[x][z] = (1ull << y) & ~masks.solidColumns[MESH_PADDING + x][MESH_PADDING + z];
+    return reached[x][z] == 0 ? 0 : floodOpenColumns(masks, reached);
+}
+
+// floods from the open blocks on each face of the chunk in turn
+ChunkConnectivity computeChunkConnectivity(const BinaryMeshMasks &masks)
+{
+    const int size = Chunk::CHUNK_SIZE;
+    ChunkConnectivity connectivity;
+    for (int face = 0; face < FACE_COUNT; face++)
+    {
+        ChunkColumns reached = {};
+        auto seed = [&](int x, int z, uint64_t bits)
+        {
+            reached[x][z] = bits & ~masks.solidColumns[MESH_PADDING + x][MESH_PADDING + z];
+        };
+        for (int i = 0; i < size; i++)
+        {
+            if (face == FACE_NEG_Z || face == FACE_POS_Z)
+            {
+                seed(i, face == FACE_NEG_Z ? 0 : size - 1, ~0ull);
+            }
+            else if (face == FACE_NEG_X || face == FACE_POS_X)
+            {
+                seed(face == FACE_NEG_X ? 0 : size - 1, i, ~0ull);
+            }
+            else
+            {
+                for (int j = 0; j < size; j++)
+                {
+                    seed(i, j, face == FACE_NEG_Y ? 1ull : 1ull << (MESH_HEIGHT - 1));
+                }
+            }
+        }
+        connectivity.faces[face] = floodOpenColumns(masks, reached);
+    }
+    return connectivity;
+}
+
+#endif
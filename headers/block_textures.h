@@ -0,0 +1,44 @@
+#ifndef BLOCK_TEXTURES_H
+#define BLOCK_TEXTURES_H
+
+#include "chunk.h"
+#include "binary_mesher.h"
+
+using namespace std;
+
+// every block type has a folder under graphics/ holding 0.png (side), 1.png (top) and 2.png (bottom).
+// all of them are loaded into the layers of one texture array, BLOCK_TEXTURE_VARIANTS layers per block type
+const char *const BLOCK_TEXTURE_FOLDERS[BLOCK_TYPE_COUNT] = {
+    nullptr, // AIR
+    "graphics/grass_block",
+    "graphics/dirt_block",
+    "graphics/sand_block",
+    "graphics/tree_block",
+    "graphics/leaf_block",
+    "graphics/water_block",
+};
+const int BLOCK_TEXTURE_VARIANTS = 3;
+const int BLOCK_TEXTURE_LAYERS = (BLOCK_TYPE_COUNT - 1) * BLOCK_TEXTURE_VARIANTS;
+// all block textures share one size so they fit in the array
+const int BLOCK_TEXTURE_SIZE = 512;
+
+// texture array layer of one face of a block type
+int blockTextureLayer(int blockType, int face)
+{
+    int variant = 0;
+    // grass is the only block with its own top and bottom so far
+    if (blockType == GRASS)
+    {
+        if (face == FACE_POS_Y)
+        {
+            variant = 1;
+        }
+        else if (face == FACE_NEG_Y)
+        {
+            variant = 2;
+        }
+    }
+    return (blockType - 1) * BLOCK_TEXTURE_VARIANTS + variant;
+}
+
+#endif
@@ -0,0 +1,559 @@
+#ifndef CHUNK_MESHER_H
+#define CHUNK_MESHER_H
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <vector>
+#include <map>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <unordered_map>
+#include <cstdint>
+#include <climits>
+#include <chrono>
+
+#include "chunk.h"
+#include "block.h"
+#include "chunk_snapshot.h"
+#include "binary_mesher.h"
+#include "mesh_cache.h"
+#include "block_textures.h"
+
+using namespace std;
+
+// contiguous range of instances that share a face direction and block type, drawn with one texture
+struct MeshGroup
+{
+    int blockType;
+    int face;
+    unsigned int first;
+    unsigned int count;
+};
+
+// the light barely moves relative to the faces it lights, so its direction is taken once per face at mesh time
+// instead of per fragment
+const glm::vec3 LIGHT_POSITION(12.0f, 60.0f, -12.0f);
+const float AMBIENT_STRENGTH = 0.3f;
+// brightness of the ambient occlusion levels of MeshQuad::ao, texture.vs holds the same table
+const float AO_BRIGHTNESS[4] = {0.5f, 0.7f, 0.85f, 1.0f};
+// baked light is stored as a normalized byte, texture.vs scales it back up by this range
+const float SHADE_RANGE = 1.5f;
+
+// one merged face in 8 bytes, positioned relative to its chunk. texture.vs adds the chunk origin and builds the face rectangle from the face and the merged size. quad packs, from the lowest bit up:
+//   5 bits x + MESH_PADDING, 5 bits z + MESH_PADDING, 6 bits y, 5 bits width - 1, 6 bits height - 1, 3 bits face,
+//   2 bits level of detail
+// leaves can hang over the chunk border, so positions cover the whole padded mesh area. sizes are in blocks at every
+// level of detail, the level only tells texture.vs how thick the cells behind the face are. light packs:
+//   8 bits baked light / SHADE_RANGE, 8 bits corner occlusion like MeshQuad::ao, 6 bits texture array layer,
+//   10 bits chunk slot. the slot is filled in when the mesh is uploaded and picks the chunk origin in texture.vs
+struct FaceInstance
+{
+    uint32_t quad;
+    uint32_t light;
+};
+
+const int FACE_INSTANCE_SLOT_SHIFT = 22;
+const int FACE_INSTANCE_SLOT_BITS = 10;
+const int FACE_INSTANCE_LOD_SHIFT = 30;
+
+static_assert(MESH_AREA <= 32 && MESH_HEIGHT <= 64, "FaceInstance bit fields are too small for the mesh area");
+static_assert(BLOCK_TEXTURE_LAYERS <= 64, "FaceInstance bit fields are too small for the texture layers");
+static_assert(MESH_LOD_COUNT <= 4, "FaceInstance bit fields are too small for the levels of detail");
+
+FaceInstance packFaceInstance(int face, int x, int y, int z, int width, int height, int lod = 0)
+{
+    FaceInstance instance;
+    instance.light = 0;
+    instance.quad = (uint32_t)(x + MESH_PADDING) | ((uint32_t)(z + MESH_PADDING) << 5) | ((uint32_t)y << 10) |
+                    ((uint32_t)(width - 1) << 16) | ((uint32_t)(height - 1) << 21) | ((uint32_t)face << 27) | ((uint32_t)lod << FACE_INSTANCE_LOD_SHIFT);
+    return instance;
+}
+
+// chunk relative position of the first block of an instance
+glm::ivec3 faceInstancePosition(const FaceInstance &instance)
+{
+    return glm::ivec3((int)(instance.quad & 31) - MESH_PADDING, (int)((instance.quad >> 10) & 63), (int)((instance.quad >> 5) & 31) - MESH_PADDING);
+}
+
+// CPU side result of meshing one chunk, face instances sorted by face and block type ready for upload.
+// the buffers are recycled between chunks so they keep their capacity
+struct ChunkMeshData
+{
+    glm::vec3 origin;
+    unsigned int revision = 0;
+    std::vector<FaceInstance> opaqueInstances;
+    std::vector<MeshGroup> opaqueGroups;
+    std::vector<FaceInstance> transparentInstances;
+    std::vector<MeshGroup> transparentGroups;
+    // world space box around all faces of the mesh, for culling
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    // occluders of the chunk for the occlusion culler, see computeSolidFloorHeights
+    uint8_t solidFloorHeights[SOLID_FLOOR_CELLS][SOLID_FLOOR_CELLS] = {};
+    // for the connectivity culling in Mesh::cullChunks, everything connects until the mesher says otherwise
+    ChunkConnectivity connectivity;
+    // level of detail the faces were meshed at
+    int lod = 0;
+    // worker time spent on the masks and quads, and on turning the quads into instances, for the frame profiler
+    float meshingMilliseconds = 0.0f;
+    float instanceMilliseconds = 0.0f;
+
+    void clear()
+    {
+        connectivity = ChunkConnectivity();
+        std::fill(&solidFloorHeights[0][0], &solidFloorHeights[0][0] + SOLID_FLOOR_CELLS * SOLID_FLOOR_CELLS, 0);
+        opaqueInstances.clear();
+        opaqueGroups.clear();
+        transparentInstances.clear();
+        transparentGroups.clear();
+        meshingMilliseconds = 0.0f;
+        instanceMilliseconds = 0.0f;
+    }
+};
+
+// blocks the quad covers along x, y and z
+glm::ivec3 quadExtent(const MeshQuad &quad)
+{
+    if (quad.face == FACE_NEG_Z || quad.face == FACE_POS_Z)
+    {
+        return glm::ivec3(quad.width, quad.height, 1);
+    }
+    if (quad.face == FACE_NEG_X || quad.face == FACE_POS_X)
+    {
+        return glm::ivec3(1, quad.height, quad.width);
+    }
+    return glm::ivec3(quad.width, 1, quad.height);
+}
+
+// world space center of the quad's face rectangle, where its light is sampled. scale is the size of the quad's cells
+// in blocks
+glm::vec3 quadFaceCenter(const glm::vec3 &origin, const MeshQuad &quad, int scale = 1)
+{
+    return origin + glm::vec3(quad.x, quad.y, quad.z) * (float)scale + glm::vec3(quadExtent(quad) * scale - glm::ivec3(1)) * 0.5f;
+}
+
+// ambient plus diffuse light of a face, packed with its corner occlusion and texture layer into instance.light.
+// texture.vs darkens the corners by AO_BRIGHTNESS
+void bakeFaceLight(int blockType, int face, const glm::vec3 &faceCenter, int ao, FaceInstance &instance)
+{
+    glm::vec3 normal(FACE_AXES[face][0][0], FACE_AXES[face][0][1], FACE_AXES[face][0][2]);
+    float diffuse = glm::max(glm::dot(normal, glm::normalize(LIGHT_POSITION - faceCenter)), 0.0f);
+    float light = glm::clamp((AMBIENT_STRENGTH + diffuse) / SHADE_RANGE, 0.0f, 1.0f);
+    instance.light = (uint32_t)(light * 255.0f + 0.5f) | ((uint32_t)ao << 8) | ((uint32_t)blockTextureLayer(blockType, face) << 16);
+}
+
+// sorts quads into the face and block type groups of meshData with a counting sort, without allocating once the
+// output buffers have grown to their working size. quads meshed at a coarser level are scaled up to blocks
+void writeQuadInstances(const glm::vec3 &origin, const std::vector<MeshQuad> &quads, ChunkMeshData &meshData, int lod = 0)
+{
+    const int scale = 1 << lod;
+    unsigned int groupCounts[2][FACE_COUNT][BLOCK_TYPE_COUNT] = {};
+    for (const auto &quad : quads)
+    {
+        groupCounts[quad.blockType == LEAF][quad.face][quad.blockType]++;
+    }
+
+    unsigned int groupStarts[2][FACE_COUNT][BLOCK_TYPE_COUNT];
+    for (int pass = 0; pass < 2; pass++)
+    {
+        std::vector<MeshGroup> &groups = pass == 0 ? meshData.opaqueGroups : meshData.transparentGroups;
+        unsigned int next = 0;
+        for (int face = 0; face < FACE_COUNT; face++)
+        {
+            for (int type = 0; type < BLOCK_TYPE_COUNT; type++)
+            {
+                groupStarts[pass][face][type] = next;
+                if (groupCounts[pass][face][type] > 0)
+                {
+                    groups.push_back(MeshGroup{type, face, next, groupCounts[pass][face][type]});
+                    next += groupCounts[pass][face][type];
+                }
+            }
+        }
+        (pass == 0 ? meshData.opaqueInstances : meshData.transparentInstances).resize(next);
+    }
+
+    glm::ivec3 blocksMin(INT_MAX), blocksMax(INT_MIN);
+    for (const auto &quad : quads)
+    {
+        glm::ivec3 first = glm::ivec3(quad.x, quad.y, quad.z) * scale;
+        blocksMin = glm::min(blocksMin, first);
+        blocksMax = glm::max(blocksMax, first + quadExtent(quad) * scale);
+
+        int pass = quad.blockType == LEAF;
+        std::vector<FaceInstance> &instances = pass == 0 ? meshData.opaqueInstances : meshData.transparentInstances;
+        FaceInstance &instance = instances[groupStarts[pass][quad.face][quad.blockType]++];
+        instance = packFaceInstance(quad.face, first.x, first.y, first.z, quad.width * scale, quad.height * scale, lod);
+        bakeFaceLight(quad.blockType, quad.face, quadFaceCenter(origin, quad, scale), quad.ao, instance);
+    }
+
+    // blocks are centered on their positions, so the faces reach half a block past the first and last block
+    if (!quads.empty())
+    {
+        meshData.boundsMin = origin + glm::vec3(blocksMin) - 0.5f;
+        meshData.boundsMax = origin + glm::vec3(blocksMax) - 0.5f;
+    }
+    else
+    {
+        meshData.boundsMin = meshData.boundsMax = origin;
+    }
+}
+
+// builds the merged face instances of the snapshot's center chunk with the binary mesher, runs on the worker threads.
+// scratch is the calling thread's working memory and meshData is overwritten, both are reused between chunks.
+// with a cache, chunks whose contents were meshed before are read back instead of being meshed again
+void buildChunkMesh(const ChunkSnapshot &snapshot, BinaryMeshScratch &scratch, ChunkMeshData &meshData, MeshCache *cache = nullptr)
+{
+    meshData.clear();
+    meshData.origin = snapshot.origin;
+    meshData.revision = snapshot.revision;
+    meshData.lod = snapshot.lod;
+    // an empty box at the origin until the faces are written, recycled mesh data still holds the last chunk's box
+    meshData.boundsMin = meshData.boundsMax = snapshot.origin;
+
+    if (snapshot.area[1][1] == nullptr)
+    {
+        return;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    fillBinaryMeshMasks(snapshot, scratch.masks);
+    computeSolidFloorHeights(scratch.masks, meshData.solidFloorHeights);
+    meshData.connectivity = computeChunkConnectivity(scratch.masks);
+    // the occluders and connectivity above come from the full resolution blocks at every level, only the faces are coarse
+    const BinaryMeshMasks *masks = &scratch.masks;
+    if (snapshot.lod > 0)
+    {
+        downsampleMeshMasks(scratch.masks, snapshot.lod, scratch.lodMasks);
+        masks = &scratch.lodMasks;
+    }
+    // the level is part of the key, coarse masks could look like the full resolution masks of another chunk
+    uint64_t contentHash = cache != nullptr ? hashMeshMasks(*masks) ^ ((uint64_t)snapshot.lod << 56) : 0;
+    if (cache == nullptr || !cache->load(contentHash, scratch.quads))
+    {
+        buildBinaryChunkQuads(scratch, *masks);
+        if (cache != nullptr)
+        {
+            cache->store(contentHash, scratch.quads);
+        }
+    }
+
+    auto meshed = std::chrono::steady_clock::now();
+
+    writeQuadInstances(snapshot.origin, scratch.quads, meshData, snapshot.lod);
+    meshData.meshingMilliseconds = std::chrono::duration<float, std::milli>(meshed - start).count();
+    meshData.instanceMilliseconds = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - meshed).count();
+}
+
+// reference mesher that tests the 6 neighbours of every block through a hash map and keeps whole exposed cubes,
+// kept for the mesher benchmark in bench/mesher_bench.cpp
+ChunkMeshData buildChunkMeshHashed(const ChunkSnapshot &snapshot)
+{
+    ChunkMeshData meshData;
+    meshData.origin = snapshot.origin;
+    meshData.revision = snapshot.revision;
+
+    const Chunk *center = snapshot.area[1][1].get();
+    if (center == nullptr)
+    {
+        return meshData;
+    }
+
+    // leaves can hang up to 2 blocks outside of their chunk, so neighbours only matter within 3 blocks of the border
+    const float margin = 3.0f;
+    const glm::vec3 minCorner = snapshot.origin - glm::vec3(margin, 0.0f, margin);
+    const glm::vec3 maxCorner = snapshot.origin + glm::vec3(Chunk::CHUNK_SIZE + margin, 0.0f, Chunk::CHUNK_SIZE + margin);
+    auto isInsideMargin = [&](const glm::vec3 &pos)
+    {
+        return pos.x >= minCorner.x && pos.x < maxCorner.x && pos.z >= minCorner.z && pos.z < maxCorner.z;
+    };
+
+    std::unordered_map<glm::vec3, int> blockPositions;
+    auto insertBlocks = [&](const std::vector<Block> &blocks, bool isCenter)
+    {
+        for (const auto &block : blocks)
+        {
+            if (block.blockType != AIR && (isCenter || isInsideMargin(block.blockPosition)))
+            {
+                blockPositions[block.blockPosition] = block.blockType;
+            }
+        }
+    };
+
+    // insert the neighbours first so the center chunk wins on overlapping positions
+    for (int dx = 0; dx < 3; dx++)
+    {
+        for (int dz = 0; dz < 3; dz++)
+        {
+            const Chunk *chunk = snapshot.area[dx][dz].get();
+            if (chunk == nullptr || chunk == center)
+            {
+                continue;
+            }
+            insertBlocks(chunk->blocks, false);
+            insertBlocks(chunk->trees, false);
+            insertBlocks(chunk->leaves, false);
+        }
+    }
+    insertBlocks(center->blocks, true);
+    insertBlocks(center->trees, true);
+    insertBlocks(center->leaves, true);
+
+    auto isMissingOrTransparent = [&](const glm::vec3 &checkPos)
+    {
+        auto it = blockPositions.find(checkPos);
+        if (it == blockPositions.end())
+        {
+            return true;
+        }
+        return it->second == LEAF;
+    };
+
+    // check if block is exposed (i.e., it has at least one open face)
+    auto isExposed = [&](const glm::vec3 &pos)
+    {
+        return isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
+               isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
+               isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
+               isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
+               isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
+               isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1));
+    };
+
+    std::map<int, std::vector<glm::vec3>> opaqueCubes;
+    std::map<int, std::vector<glm::vec3>> transparentCubes;
+    auto addCubes = [&](const std::vector<Block> &blocks, std::map<int, std::vector<glm::vec3>> &cubes)
+    {
+        for (const auto &block : blocks)
+        {
+            if (block.blockType != AIR && isExposed(block.blockPosition))
+            {
+                cubes[block.blockType].push_back(block.blockPosition);
+            }
+        }
+    };
+
+    meshData.boundsMin = snapshot.origin - glm::vec3(MESH_PADDING + 0.5f, 0.5f, MESH_PADDING + 0.5f);
+    meshData.boundsMax = snapshot.origin + glm::vec3(Chunk::CHUNK_SIZE + MESH_PADDING - 0.5f, MESH_HEIGHT - 0.5f, Chunk::CHUNK_SIZE + MESH_PADDING - 0.5f);
+    addCubes(center->blocks, opaqueCubes);
+    addCubes(center->trees, opaqueCubes);
+    addCubes(center->leaves, transparentCubes);
+
+    // every exposed cube is drawn with all 6 of its faces
+    auto writeGroups = [&](const std::map<int, std::vector<glm::vec3>> &cubes, std::vector<FaceInstance> &instances, std::vector<MeshGroup> &groups)
+    {
+        for (int face = 0; face < FACE_COUNT; face++)
+        {
+            for (const auto &pair : cubes)
+            {
+                groups.push_back(MeshGroup{pair.first, face, (unsigned int)instances.size(), (unsigned int)pair.second.size()});
+                for (const auto &position : pair.second)
+                {
+                    glm::vec3 local = position - snapshot.origin;
+                    FaceInstance instance = packFaceInstance(face, (int)local.x, (int)local.y, (int)local.z, 1, 1);
+                    bakeFaceLight(pair.first, face, position, AO_OPEN, instance);
+                    instances.push_back(instance);
+                }
+            }
+        }
+    };
+    writeGroups(opaqueCubes, meshData.opaqueInstances, meshData.opaqueGroups);
+    writeGroups(transparentCubes, meshData.transparentInstances, meshData.transparentGroups);
+
+    return meshData;
+}
+
+// first in first out over a vector that keeps its capacity, so pushing and popping stop allocating once it has grown
+// to the longest backlog. a deque frees and allocates its blocks as the queue moves along
+template <typename T>
+class ReusableQueue
+{
+public:
+    void push_back(T &&item)
+    {
+        items.push_back(std::move(item));
+    }
+
+    bool empty() const
+    {
+        return head == items.size();
+    }
+
+    size_t size() const
+    {
+        return items.size() - head;
+    }
+
+    // moves the oldest item out
+    T take_front()
+    {
+        T item = std::move(items[head++]);
+        if (head == items.size())
+        {
+            items.clear();
+            head = 0;
+        }
+        else if (head * 2 >= items.size())
+        {
+            // the taken half is only moved out items, shift the rest down instead of growing past the backlog
+            items.erase(items.begin(), items.begin() + head);
+            head = 0;
+        }
+        return item;
+    }
+
+private:
+    std::vector<T> items;
+    size_t head = 0;
+};
+
+// fixed set of worker threads that mesh chunk snapshots, results are collected by the render thread
+class MeshWorkerPool
+{
+public:
+    MeshWorkerPool(MeshCache *meshCache = nullptr) : cache(meshCache)
+    {
+        unsigned int threadCount = std::thread::hardware_concurrency();
+        // leave one core for the render thread
+        threadCount = threadCount > 1 ? threadCount - 1 : 1;
+        recycledMeshes.reserve(MAX_RECYCLED_MESHES);
+        for (unsigned int i = 0; i < threadCount; i++)
+        {
+            workers.emplace_back(&MeshWorkerPool::workerLoop, this);
+        }
+    }
+
+    ~MeshWorkerPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobCondition.notify_all();
+        for (auto &worker : workers)
+        {
+            worker.join();
+        }
+    }
+
+    MeshWorkerPool(const MeshWorkerPool &) = delete;
+    MeshWorkerPool &operator=(const MeshWorkerPool &) = delete;
+
+    void submit(ChunkSnapshot snapshot)
+    {
+        unfinished++;
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobs.push_back(std::move(snapshot));
+        }
+        jobCondition.notify_one();
+    }
+
+    // hands the buffers of a mesh that is no longer needed back to the workers for reuse
+    void recycle(ChunkMeshData &&meshData)
+    {
+        std::lock_guard<std::mutex> lock(recycleMutex);
+        if (recycledMeshes.size() < MAX_RECYCLED_MESHES)
+        {
+            recycledMeshes.push_back(std::move(meshData));
+        }
+    }
+
+    // pops a single finished mesh, returns false when nothing is ready
+    bool tryPopResult(ChunkMeshData &result)
+    {
+        std::lock_guard<std::mutex> lock(resultMutex);
+        if (results.empty())
+        {
+            return false;
+        }
+        result = results.take_front();
+        unfinished--;
+        return true;
+    }
+
+    // meshes submitted whose results have not been popped yet, whether queued, being meshed or finished
+    size_t pendingJobs() const
+    {
+        return unfinished.load();
+    }
+
+private:
+    MeshCache *cache;
+    std::vector<std::thread> workers;
+
+    std::atomic<size_t> unfinished{0};
+    std::mutex jobMutex;
+    std::condition_variable jobCondition;
+    ReusableQueue<ChunkSnapshot> jobs;
+    bool stopping = false;
+
+    std::mutex resultMutex;
+    ReusableQueue<ChunkMeshData> results;
+
+    // finished meshes whose buffers can be reused, capped so a burst of loads does not pin memory forever
+    static const size_t MAX_RECYCLED_MESHES = 64;
+    std::mutex recycleMutex;
+    std::vector<ChunkMeshData> recycledMeshes;
+    // instances of the largest meshes so far. a recycled mesh goes to whichever chunk comes next, so every mesh is
+    // reserved to these and one that only held small chunks does not grow again for a large one
+    std::atomic<size_t> mostOpaqueInstances{0};
+    std::atomic<size_t> mostTransparentInstances{0};
+
+    static void raiseTo(std::atomic<size_t> &most, size_t count)
+    {
+        size_t seen = most.load();
+        while (count > seen && !most.compare_exchange_weak(seen, count))
+        {
+        }
+    }
+
+    ChunkMeshData takeRecycledMesh()
+    {
+        std::lock_guard<std::mutex> lock(recycleMutex);
+        if (recycledMeshes.empty())
+        {
+            return ChunkMeshData();
+        }
+        ChunkMeshData meshData = std::move(recycledMeshes.back());
+        recycledMeshes.pop_back();
+        return meshData;
+    }
+
+    void workerLoop()
+    {
+        // per thread scratch arena, allocated once for the lifetime of the worker
+        std::unique_ptr<BinaryMeshScratch> scratch(new BinaryMeshScratch());
+        while (true)
+        {
+            ChunkSnapshot snapshot;
+            {
+                std::unique_lock<std::mutex> lock(jobMutex);
+                jobCondition.wait(lock, [this]
+                                  { return stopping || !jobs.empty(); });
+                if (stopping)
+                {
+                    return;
+                }
+                snapshot = jobs.take_front();
+            }
+
+            ChunkMeshData meshData = takeRecycledMesh();
+            meshData.opaqueInstances.reserve(mostOpaqueInstances.load());
+            meshData.transparentInstances.reserve(mostTransparentInstances.load());
+            meshData.opaqueGroups.reserve(FACE_COUNT * BLOCK_TYPE_COUNT);
+            meshData.transparentGroups.reserve(FACE_COUNT * BLOCK_TYPE_COUNT);
+            buildChunkMesh(snapshot, *scratch, meshData, cache);
+            raiseTo(mostOpaqueInstances, meshData.opaqueInstances.size());
+            raiseTo(mostTransparentInstances, meshData.transparentInstances.size());
+
+            std::lock_guard<std::mutex> lock(resultMutex);
+            results.push_back(std::move(meshData));
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,253 @@
+#ifndef CHUNK_QUADTREE_H
+#define CHUNK_QUADTREE_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cfloat>
+
+#include "frustrum_culling.h"
+
+using namespace std;
+
+// leaves cover QUADTREE_LEAF_CHUNKS x QUADTREE_LEAF_CHUNKS chunk columns and test their chunks as one batch
+const int QUADTREE_LEAF_CHUNKS = 4;
+
+// where a chunk's box lives in the tree
+struct QuadtreeHandle
+{
+    int leaf = -1;
+    int slot = -1;
+};
+
+// quadtree over the loaded chunk columns in chunk coordinates. every node keeps a box around everything below it, so
+// the frustrum can accept or reject whole regions with one test. the root doubles whenever a chunk lands outside it
+class ChunkQuadtree
+{
+public:
+    // nodes and chunk boxes tested by the last cull
+    int nodesTested = 0;
+    int chunksTested = 0;
+
+    QuadtreeHandle insert(int id, int chunkX, int chunkZ, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+    {
+        if (root < 0)
+        {
+            root = createNode(floorTo(chunkX, QUADTREE_LEAF_CHUNKS), floorTo(chunkZ, QUADTREE_LEAF_CHUNKS), QUADTREE_LEAF_CHUNKS, -1);
+        }
+        while (!covers(nodes[root], chunkX, chunkZ))
+        {
+            growRoot(chunkX, chunkZ);
+        }
+
+        int node = root;
+        while (nodes[node].size > QUADTREE_LEAF_CHUNKS)
+        {
+            int half = nodes[node].size / 2;
+            int child = (chunkX - nodes[node].x >= half) + 2 * (chunkZ - nodes[node].z >= half);
+            if (nodes[node].children[child] < 0)
+            {
+                int childNode = createNode(nodes[node].x + (child & 1) * half, nodes[node].z + (child >> 1) * half, half, node);
+                nodes[node].children[child] = childNode;
+            }
+            node = nodes[node].children[child];
+        }
+
+        QuadtreeHandle handle;
+        handle.leaf = node;
+        if (!nodes[node].freeSlots.empty())
+        {
+            handle.slot = nodes[node].freeSlots.back();
+            nodes[node].freeSlots.pop_back();
+            nodes[node].boxes.set(handle.slot, boxMin, boxMax);
+            nodes[node].ids[handle.slot] = id;
+        }
+        else
+        {
+            handle.slot = (int)nodes[node].boxes.add(boxMin, boxMax);
+            nodes[node].ids.push_back(id);
+        }
+        expandBounds(node, boxMin, boxMax);
+        return handle;
+    }
+
+    void update(const QuadtreeHandle &handle, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+    {
+        nodes[handle.leaf].boxes.set(handle.slot, boxMin, boxMax);
+        // node boxes only ever grow, which keeps them conservative without rescanning the leaf
+        expandBounds(handle.leaf, boxMin, boxMax);
+    }
+
+    // empties the chunk's place in its leaf for the next insert there. the box left behind is inside out, so it fails
+    // every plane test, and the node boxes keep their size like they do in update
+    void remove(const QuadtreeHandle &handle)
+    {
+        Node &leaf = nodes[handle.leaf];
+        leaf.boxes.set(handle.slot, glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX));
+        leaf.ids[handle.slot] = -1;
+        leaf.freeSlots.push_back(handle.slot);
+    }
+
+    // appends the ids of all chunks whose box touches the frustrum
+    void cull(const FrustrumPlanes &planes, std::vector<int> &visibleIds)
+    {
+        nodesTested = 0;
+        chunksTested = 0;
+        if (root >= 0)
+        {
+            cullNode(root, planes, ALL_PLANES, visibleIds);
+        }
+    }
+
+    void clear()
+    {
+        nodes.clear();
+        root = -1;
+    }
+
+private:
+    static const int ALL_PLANES = (1 << 6) - 1;
+
+    struct Node
+    {
+        // first chunk column and width in chunks
+        int x, z, size;
+        int parent;
+        int children[4] = {-1, -1, -1, -1};
+        glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+        glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+        // only used by leaves, removed chunks leave an id of -1 and their slot in freeSlots
+        BoxCullList boxes;
+        std::vector<int> ids;
+        std::vector<int> freeSlots;
+    };
+
+    std::vector<Node> nodes;
+    int root = -1;
+    // per leaf results of the batched box test
+    std::vector<uint8_t> leafVisible;
+
+    static int floorTo(int value, int step)
+    {
+        return value >= 0 ? value / step * step : -((-value + step - 1) / step) * step;
+    }
+
+    static bool covers(const Node &node, int chunkX, int chunkZ)
+    {
+        return chunkX >= node.x && chunkX < node.x + node.size && chunkZ >= node.z && chunkZ < node.z + node.size;
+    }
+
+    int createNode(int x, int z, int size, int parent)
+    {
+        Node node;
+        node.x = x;
+        node.z = z;
+        node.size = size;
+        node.parent = parent;
+        nodes.push_back(node);
+        return (int)nodes.size() - 1;
+    }
+
+    // puts a root twice as large above the current one, extended towards the chunk
+    void growRoot(int chunkX, int chunkZ)
+    {
+        const Node &oldRoot = nodes[root];
+        int size = oldRoot.size;
+        int x = chunkX < oldRoot.x ? oldRoot.x - size : oldRoot.x;
+        int z = chunkZ < oldRoot.z ? oldRoot.z - size : oldRoot.z;
+        glm::vec3 boundsMin = oldRoot.boundsMin, boundsMax = oldRoot.boundsMax;
+        int oldRootIndex = root;
+        root = createNode(x, z, size * 2, -1);
+        int child = (nodes[oldRootIndex].x != x) + 2 * (nodes[oldRootIndex].z != z);
+        nodes[root].children[child] = oldRootIndex;
+        nodes[root].boundsMin = boundsMin;
+        nodes[root].boundsMax = boundsMax;
+        nodes[oldRootIndex].parent = root;
+    }
+
+    void expandBounds(int node, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+    {
+        for (; node >= 0; node = nodes[node].parent)
+        {
+            nodes[node].boundsMin = glm::min(nodes[node].boundsMin, boxMin);
+            nodes[node].boundsMax = glm::max(nodes[node].boundsMax, boxMax);
+        }
+    }
+
+    // planeMask holds the planes the node is not yet known to be fully inside of, children only test those
+    void cullNode(int index, const FrustrumPlanes &planes, int planeMask, std::vector<int> &visibleIds)
+    {
+        Node &node = nodes[index];
+        nodesTested++;
+        for (int p = 0; p < 6; p++)
+        {
+            if ((planeMask & (1 << p)) == 0)
+            {
+                continue;
+            }
+            glm::vec3 normal(planes.normalX[p], planes.normalY[p], planes.normalZ[p]);
+            glm::vec3 furthest(normal.x >= 0.0f ? node.boundsMax.x : node.boundsMin.x,
+                               normal.y >= 0.0f ? node.boundsMax.y : node.boundsMin.y,
+                               normal.z >= 0.0f ? node.boundsMax.z : node.boundsMin.z);
+            if (glm::dot(normal, furthest) + planes.distance[p] < 0.0f)
+            {
+                return;
+            }
+            glm::vec3 nearest(normal.x >= 0.0f ? node.boundsMin.x : node.boundsMax.x,
+                              normal.y >= 0.0f ? node.boundsMin.y : node.boundsMax.y,
+                              normal.z >= 0.0f ? node.boundsMin.z : node.boundsMax.z);
+            if (glm::dot(normal, nearest) + planes.distance[p] >= 0.0f)
+            {
+                planeMask &= ~(1 << p);
+            }
+        }
+
+        if (planeMask == 0)
+        {
+            // fully inside, everything below is visible without further tests
+            collectIds(index, visibleIds);
+            return;
+        }
+        if (node.size == QUADTREE_LEAF_CHUNKS)
+        {
+            chunksTested += (int)node.boxes.size();
+            leafVisible.resize(node.boxes.paddedSize());
+            node.boxes.cull(planes, leafVisible.data());
+            for (size_t i = 0; i < node.boxes.size(); i++)
+            {
+                if (leafVisible[i] && node.ids[i] >= 0)
+                {
+                    visibleIds.push_back(node.ids[i]);
+                }
+            }
+            return;
+        }
+        for (int child = 0; child < 4; child++)
+        {
+            if (node.children[child] >= 0)
+            {
+                cullNode(node.children[child], planes, planeMask, visibleIds);
+            }
+        }
+    }
+
+    void collectIds(int index, std::vector<int> &visibleIds)
+    {
+        const Node &node = nodes[index];
+        for (int id : node.ids)
+        {
+            if (id >= 0)
+            {
+                visibleIds.push_back(id);
+            }
+        }
+        for (int child = 0; child < 4; child++)
+        {
+            if (node.children[child] >= 0)
+            {
+                collectIds(node.children[child], visibleIds);
+            }
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,46 @@
+#ifndef CHUNK_SNAPSHOT_H
+#define CHUNK_SNAPSHOT_H
+
+#include <glm/glm.hpp>
+#include <memory>
+#include <unordered_map>
+
+#include "chunk.h"
+#include "block.h"
+
+using namespace std;
+
+// chunks are shared with the mesh workers, so once a chunk is built it is never modified again
+typedef std::unordered_map<glm::vec3, std::shared_ptr<const Chunk>> ChunkMap;
+
+// immutable view of a chunk and the 8 chunks around it, area[1][1] is the chunk being meshed
+// missing neighbours are left as nullptr and treated as air
+struct ChunkSnapshot
+{
+    glm::vec3 origin;
+    unsigned int revision = 0;
+    // level of detail to mesh the chunk at, see downsampleMeshMasks
+    int lod = 0;
+    std::shared_ptr<const Chunk> area[3][3];
+};
+
+ChunkSnapshot createChunkSnapshot(const ChunkMap &chunks, const glm::vec3 &origin)
+{
+    ChunkSnapshot snapshot;
+    snapshot.origin = origin;
+    for (int dx = -1; dx <= 1; dx++)
+    {
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            glm::vec3 neighbourOrigin = origin + glm::vec3(dx * (float)Chunk::CHUNK_SIZE, 0.0f, dz * (float)Chunk::CHUNK_SIZE);
+            auto it = chunks.find(neighbourOrigin);
+            if (it != chunks.end())
+            {
+                snapshot.area[dx + 1][dz + 1] = it->second;
+            }
+        }
+    }
+    return snapshot;
+}
+
+#endif
@@ -0,0 +1,309 @@
+#ifndef FRAME_BENCHMARK_H
+#define FRAME_BENCHMARK_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <glm/gtc/constants.hpp>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+
+using namespace std;
+
+// how the program was started, see printUsage
+struct RunOptions
+{
+    // render into an offscreen framebuffer without a display and follow the camera path instead of input
+    bool headless = false;
+    // create the headless context through EGL instead of OSMesa
+    bool useEGL = false;
+    // frames rendered at the path's start before timing begins at the least. the warm up goes on until the chunks
+    // around it are loaded, meshed and uploaded
+    int warmupFrames = 120;
+    // frames timed along the camera path
+    int frames = 600;
+    std::string statsPath = "frame_stats.txt";
+    // keyframes of the camera path, the built in circle when empty
+    std::string cameraPath;
+    // start with the frame profiler on, headless runs print its breakdown at the end
+    bool profile = false;
+    // draw the opaque chunks' depth first
+    bool depthPrepass = false;
+    // count the fragments shaded per pixel, headless runs print the average at the end
+    bool overdraw = false;
+    // frame rate the view distance is adjusted to hold
+    double targetFps = 60.0;
+    // keep the view distance at this many chunks instead of adjusting it, 0 adjusts it in a window and keeps the
+    // starting distance in headless runs
+    int viewDistance = 0;
+    // adjust the view distance in headless runs too, which makes their frame statistics depend on the machine
+    bool adaptiveViewDistance = false;
+};
+
+void printUsage(const char *program)
+{
+    cout << "usage: " << program << " [--headless] [--egl] [--warmup N] [--frames N] [--stats FILE] [--camera-path FILE] [--profile] [--depth-prepass] [--overdraw] [--target-fps N] [--view-distance N] [--adaptive-view-distance]\n"
+         << "  --headless          render offscreen along the camera path and write frame time statistics\n"
+         << "  --egl               create the headless context with EGL instead of OSMesa\n"
+         << "  --warmup N          untimed frames before the benchmark at the least, more until the chunks around the\n"
+         << "                      path's start are loaded and meshed, default 120\n"
+         << "  --frames N          timed frames, default 600\n"
+         << "  --stats FILE        where the statistics go, default frame_stats.txt\n"
+         << "  --camera-path FILE  keyframes, one 'x y z yaw pitch' per line, spread evenly over the frames\n"
+         << "  --profile           start with the frame profiler on, F3 toggles it in a window\n"
+         << "  --depth-prepass     start with the depth pre-pass on, F4 toggles it in a window\n"
+         << "  --overdraw          start with the overdraw counter on, F5 toggles it in a window\n"
+         << "  --target-fps N      frame rate the view distance grows or shrinks to hold, default 60\n"
+         << "  --view-distance N   keep the view distance at N chunks instead of adjusting it, headless runs keep the\n"
+         << "                      starting distance unless --adaptive-view-distance is given\n"
+         << "  --adaptive-view-distance\n"
+         << "                      adjust the view distance in headless runs too\n";
+}
+
+// false after printing the usage when the arguments make no sense
+bool parseRunOptions(int argc, char **argv, RunOptions &options)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        std::string argument = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (argument == "--headless")
+        {
+            options.headless = true;
+        }
+        else if (argument == "--profile")
+        {
+            options.profile = true;
+        }
+        else if (argument == "--depth-prepass")
+        {
+            options.depthPrepass = true;
+        }
+        else if (argument == "--overdraw")
+        {
+            options.overdraw = true;
+        }
+        else if (argument == "--adaptive-view-distance")
+        {
+            options.adaptiveViewDistance = true;
+        }
+        else if (argument == "--egl")
+        {
+            options.useEGL = true;
+        }
+        else if (argument == "--warmup" && hasValue)
+        {
+            options.warmupFrames = std::max(0, atoi(argv[++i]));
+        }
+        else if (argument == "--frames" && hasValue)
+        {
+            options.frames = std::max(1, atoi(argv[++i]));
+        }
+        else if (argument == "--stats" && hasValue)
+        {
+            options.statsPath = argv[++i];
+        }
+        else if (argument == "--camera-path" && hasValue)
+        {
+            options.cameraPath = argv[++i];
+        }
+        else if (argument == "--target-fps" && hasValue)
+        {
+            options.targetFps = atof(argv[++i]);
+        }
+        else if (argument == "--view-distance" && hasValue)
+        {
+            options.viewDistance = std::max(1, atoi(argv[++i]));
+        }
+        else
+        {
+            printUsage(argv[0]);
+            return false;
+        }
+    }
+    return true;
+}
+
+struct CameraKey
+{
+    glm::vec3 position;
+    float yaw;
+    float pitch;
+};
+
+// camera poses for scripted runs, linearly interpolated between keyframes
+class CameraPath
+{
+public:
+    std::vector<CameraKey> keys;
+
+    bool load(const std::string &path)
+    {
+        std::ifstream file(path);
+        if (!file)
+        {
+            cerr << "Failed to open camera path " << path << "\n";
+            return false;
+        }
+        keys.clear();
+        std::string line;
+        while (std::getline(file, line))
+        {
+            if (line.empty() || line[0] == '#')
+            {
+                continue;
+            }
+            std::istringstream values(line);
+            CameraKey key;
+            if (!(values >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch))
+            {
+                cerr << "Bad camera path line: " << line << "\n";
+                return false;
+            }
+            keys.push_back(key);
+        }
+        if (keys.empty())
+        {
+            cerr << "Camera path " << path << " has no keyframes\n";
+            return false;
+        }
+        return true;
+    }
+
+    // one slow circle over the terrain around the spawn point, looking along the direction of travel
+    void makeDefault()
+    {
+        keys.clear();
+        const int steps = 32;
+        const float radius = 48.0f;
+        for (int i = 0; i <= steps; i++)
+        {
+            float angle = glm::two_pi<float>() * i / steps;
+            CameraKey key;
+            key.position = glm::vec3(8.0f + radius * std::cos(angle), 22.0f, 8.0f + radius * std::sin(angle));
+            key.yaw = glm::degrees(angle) + 90.0f;
+            key.pitch = -15.0f;
+            keys.push_back(key);
+        }
+    }
+
+    // t runs from 0 at the first keyframe to 1 at the last
+    CameraKey sample(float t) const
+    {
+        if (keys.size() == 1)
+        {
+            return keys[0];
+        }
+        float position = glm::clamp(t, 0.0f, 1.0f) * (keys.size() - 1);
+        size_t index = std::min((size_t)position, keys.size() - 2);
+        float blend = position - index;
+        const CameraKey &a = keys[index];
+        const CameraKey &b = keys[index + 1];
+        CameraKey key;
+        key.position = glm::mix(a.position, b.position, blend);
+        key.yaw = glm::mix(a.yaw, b.yaw, blend);
+        key.pitch = glm::mix(a.pitch, b.pitch, blend);
+        return key;
+    }
+};
+
+// frame times of a benchmark run and their summary
+class FrameStats
+{
+public:
+    std::vector<double> frameMilliseconds;
+
+    void add(double milliseconds)
+    {
+        frameMilliseconds.push_back(milliseconds);
+    }
+
+    // plain "name value" lines so scripts can pick out what they compare
+    bool write(const std::string &path, const std::string &renderer) const
+    {
+        std::ofstream file(path, std::ios::trunc);
+        if (!file)
+        {
+            cerr << "Failed to write frame statistics to " << path << "\n";
+            return false;
+        }
+        std::vector<double> sorted = frameMilliseconds;
+        std::sort(sorted.begin(), sorted.end());
+        double total = 0.0;
+        for (double milliseconds : sorted)
+        {
+            total += milliseconds;
+        }
+        double mean = sorted.empty() ? 0.0 : total / sorted.size();
+        file << "renderer " << renderer << "\n";
+        file << "frames " << sorted.size() << "\n";
+        file << "mean_ms " << mean << "\n";
+        file << "min_ms " << percentile(sorted, 0.0) << "\n";
+        file << "median_ms " << percentile(sorted, 0.5) << "\n";
+        file << "p95_ms " << percentile(sorted, 0.95) << "\n";
+        file << "p99_ms " << percentile(sorted, 0.99) << "\n";
+        file << "max_ms " << percentile(sorted, 1.0) << "\n";
+        file << "fps " << (mean > 0.0 ? 1000.0 / mean : 0.0) << "\n";
+        cout << "Frame statistics written to " << path << ": mean " << mean << " ms, p99 " << percentile(sorted, 0.99) << " ms\n";
+        return true;
+    }
+
+private:
+    static double percentile(const std::vector<double> &sorted, double fraction)
+    {
+        if (sorted.empty())
+        {
+            return 0.0;
+        }
+        return sorted[std::min(sorted.size() - 1, (size_t)std::ceil(fraction * (sorted.size() - 1)))];
+    }
+};
+
+// color and depth renderbuffers to render into when there is no window to present to
+class OffscreenTarget
+{
+public:
+    unsigned int framebuffer = 0;
+
+    bool create(int width, int height)
+    {
+        glGenFramebuffers(1, &framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glGenRenderbuffers(1, &color);
+        glBindRenderbuffer(GL_RENDERBUFFER, color);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glGenRenderbuffers(1, &depth);
+        glBindRenderbuffer(GL_RENDERBUFFER, depth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, width, height);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            cerr << "Offscreen framebuffer is incomplete\n";
+            return false;
+        }
+        glViewport(0, 0, width, height);
+        return true;
+    }
+
+    void release()
+    {
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        glDeleteRenderbuffers(1, &color);
+        glDeleteRenderbuffers(1, &depth);
+        glDeleteFramebuffers(1, &framebuffer);
+        framebuffer = 0;
+    }
+
+private:
+    unsigned int color = 0;
+    unsigned int depth = 0;
+};
+
+#endif
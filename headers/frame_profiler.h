@@ -0,0 +1,460 @@
+#ifndef FRAME_PROFILER_H
+#define FRAME_PROFILER_H
+
+#include <glad/glad.h>
+#include <chrono>
+#include <algorithm>
+#include <cstdio>
+#include <cstdint>
+#include <iostream>
+
+using namespace std;
+
+// parts of a frame that are timed. world runs on the world thread and meshing and instances on the mesh workers,
+// they are the time behind the snapshots and meshes that arrived in the frame rather than time the render thread
+// waited for
+enum ProfileStage
+{
+    PROFILE_INPUT,
+    PROFILE_WORLD,
+    PROFILE_CHUNK_LOADING,
+    PROFILE_MESHING,
+    PROFILE_INSTANCES,
+    PROFILE_UPLOADS,
+    PROFILE_CULLING,
+    PROFILE_SKYBOX,
+    PROFILE_WORLD_OPAQUE,
+    PROFILE_WORLD_TRANSPARENT,
+    PROFILE_STAGE_COUNT
+};
+
+const char *const PROFILE_STAGE_NAMES[PROFILE_STAGE_COUNT] = {
+    "input", "world (thread)", "chunk loading", "meshing (workers)", "instances (workers)", "uploads", "culling", "skybox", "world opaque", "world transparent"};
+
+// frames of breakdowns kept for averaging and dumping
+const int PROFILER_HISTORY = 240;
+// frames the GPU results may lag behind. a query is only read once the driver says it is available, so the
+// readback never waits for the GPU
+const int PROFILER_QUERY_FRAMES = 4;
+
+// timing breakdown of one frame in milliseconds. gpu times arrive a few frames later, gpuReady says whether they have
+struct FrameProfile
+{
+    uint64_t frame = 0;
+    double frameMilliseconds = 0.0;
+    double cpuMilliseconds[PROFILE_STAGE_COUNT] = {};
+    double gpuMilliseconds[PROFILE_STAGE_COUNT] = {};
+    bool gpuReady = false;
+};
+
+// CPU scopes timed with steady_clock and GPU scopes timed with GL_TIME_ELAPSED queries, kept in a ring of per frame
+// breakdowns. costs nothing but a branch per scope while disabled
+class FrameProfiler
+{
+public:
+    bool enabled = false;
+
+    void create()
+    {
+        glGenQueries(PROFILER_QUERY_FRAMES * PROFILE_STAGE_COUNT, &queries[0][0]);
+    }
+
+    void release()
+    {
+        glDeleteQueries(PROFILER_QUERY_FRAMES * PROFILE_STAGE_COUNT, &queries[0][0]);
+    }
+
+    void setEnabled(bool value)
+    {
+        enabled = value;
+        // results still in flight belong to frames from before the switch
+        for (auto &slot : querySlots)
+        {
+            slot.pending = false;
+        }
+        frameCount = 0;
+    }
+
+    void beginFrame()
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        collectQueries();
+        current = FrameProfile();
+        current.frame = frameNumber;
+        frameStart = std::chrono::steady_clock::now();
+
+        QuerySlot &slot = querySlots[frameNumber % PROFILER_QUERY_FRAMES];
+        // a slot still unread from PROFILER_QUERY_FRAMES frames ago is given up on, that frame keeps no GPU times
+        slot.pending = true;
+        slot.frame = frameNumber;
+        slot.usedStages = 0;
+    }
+
+    void endFrame()
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        current.frameMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - frameStart).count();
+        QuerySlot &slot = querySlots[frameNumber % PROFILER_QUERY_FRAMES];
+        if (slot.usedStages == 0)
+        {
+            slot.pending = false;
+            current.gpuReady = true;
+        }
+        history[frameNumber % PROFILER_HISTORY] = current;
+        frameNumber++;
+        frameCount++;
+    }
+
+    // gpu also times the GL commands of the stage. GL_TIME_ELAPSED queries cannot nest, so a gpu stage inside another
+    // one is timed on the CPU only
+    void beginStage(ProfileStage stage, bool gpu)
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        stageStarts[stage] = std::chrono::steady_clock::now();
+        if (gpu && activeGpuStage < 0)
+        {
+            QuerySlot &slot = querySlots[frameNumber % PROFILER_QUERY_FRAMES];
+            glBeginQuery(GL_TIME_ELAPSED, queries[frameNumber % PROFILER_QUERY_FRAMES][stage]);
+            slot.usedStages |= 1u << stage;
+            activeGpuStage = stage;
+        }
+    }
+
+    void endStage(ProfileStage stage)
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        current.cpuMilliseconds[stage] += std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - stageStarts[stage]).count();
+        if (activeGpuStage == stage)
+        {
+            glEndQuery(GL_TIME_ELAPSED);
+            activeGpuStage = -1;
+        }
+    }
+
+    // time measured somewhere else, like on the mesh workers
+    void addTime(ProfileStage stage, double milliseconds)
+    {
+        if (enabled)
+        {
+            current.cpuMilliseconds[stage] += milliseconds;
+        }
+    }
+
+    // average of the last frames frames. gpu times only count the frames whose queries have been read back
+    FrameProfile average(int frames) const
+    {
+        FrameProfile result;
+        int count = (int)std::min<uint64_t>((uint64_t)std::min(frames, PROFILER_HISTORY), frameCount);
+        int gpuCount = 0;
+        for (int i = 1; i <= count; i++)
+        {
+            const FrameProfile &profile = history[(frameNumber - i) % PROFILER_HISTORY];
+            result.frameMilliseconds += profile.frameMilliseconds;
+            for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+            {
+                result.cpuMilliseconds[stage] += profile.cpuMilliseconds[stage];
+                if (profile.gpuReady)
+                {
+                    result.gpuMilliseconds[stage] += profile.gpuMilliseconds[stage];
+                }
+            }
+            gpuCount += profile.gpuReady;
+        }
+        result.frame = count;
+        result.gpuReady = gpuCount > 0;
+        for (int stage = 0; stage < PROFILE_STAGE_COUNT && count > 0; stage++)
+        {
+            result.cpuMilliseconds[stage] /= count;
+            result.gpuMilliseconds[stage] /= std::max(gpuCount, 1);
+        }
+        result.frameMilliseconds /= std::max(count, 1);
+        return result;
+    }
+
+    // table of the average over the last frames frames
+    void print(int frames) const
+    {
+        FrameProfile profile = average(frames);
+        char line[128];
+        snprintf(line, sizeof(line), "frame profile, %d frames averaged, %.3f ms per frame\n", (int)profile.frame, profile.frameMilliseconds);
+        cout << line;
+        snprintf(line, sizeof(line), "  %-20s %10s %10s\n", "stage", "cpu ms", "gpu ms");
+        cout << line;
+        for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+        {
+            if (profile.gpuReady && (timedOnGpu >> stage & 1))
+            {
+                snprintf(line, sizeof(line), "  %-20s %10.3f %10.3f\n", PROFILE_STAGE_NAMES[stage], profile.cpuMilliseconds[stage], profile.gpuMilliseconds[stage]);
+            }
+            else
+            {
+                snprintf(line, sizeof(line), "  %-20s %10.3f %10s\n", PROFILE_STAGE_NAMES[stage], profile.cpuMilliseconds[stage], "-");
+            }
+            cout << line;
+        }
+    }
+
+private:
+    struct QuerySlot
+    {
+        bool pending = false;
+        uint64_t frame = 0;
+        uint32_t usedStages = 0;
+    };
+    unsigned int queries[PROFILER_QUERY_FRAMES][PROFILE_STAGE_COUNT] = {};
+    QuerySlot querySlots[PROFILER_QUERY_FRAMES];
+    FrameProfile history[PROFILER_HISTORY];
+    FrameProfile current;
+    uint64_t frameNumber = 0;
+    // frames recorded since the profiler was enabled
+    uint64_t frameCount = 0;
+    // stages that have ever had a GPU query, the others show no GPU column
+    uint32_t timedOnGpu = 0;
+    int activeGpuStage = -1;
+    std::chrono::steady_clock::time_point frameStart;
+    std::chrono::steady_clock::time_point stageStarts[PROFILE_STAGE_COUNT];
+
+    // reads back every finished frame whose queries the GPU has completed, oldest first
+    void collectQueries()
+    {
+        for (uint64_t frame = frameNumber >= PROFILER_QUERY_FRAMES ? frameNumber - PROFILER_QUERY_FRAMES : 0; frame < frameNumber; frame++)
+        {
+            unsigned int index = frame % PROFILER_QUERY_FRAMES;
+            QuerySlot &slot = querySlots[index];
+            if (!slot.pending || slot.frame != frame)
+            {
+                continue;
+            }
+            // queries complete in order, the last stage of the frame being done means all of them are
+            GLuint available = GL_TRUE;
+            for (int stage = PROFILE_STAGE_COUNT - 1; stage >= 0; stage--)
+            {
+                if (slot.usedStages >> stage & 1)
+                {
+                    glGetQueryObjectuiv(queries[index][stage], GL_QUERY_RESULT_AVAILABLE, &available);
+                    break;
+                }
+            }
+            if (!available)
+            {
+                return;
+            }
+
+            FrameProfile &profile = history[frame % PROFILER_HISTORY];
+            if (profile.frame != frame)
+            {
+                slot.pending = false;
+                continue;
+            }
+            for (int stage = 0; stage < PROFILE_STAGE_COUNT; stage++)
+            {
+                if (slot.usedStages >> stage & 1)
+                {
+                    GLuint64 nanoseconds = 0;
+                    glGetQueryObjectui64v(queries[index][stage], GL_QUERY_RESULT, &nanoseconds);
+                    profile.gpuMilliseconds[stage] = nanoseconds / 1e6;
+                }
+            }
+            timedOnGpu |= slot.usedStages;
+            profile.gpuReady = true;
+            slot.pending = false;
+        }
+    }
+};
+
+// fragments that passed the depth test between begin and end, per pixel of the target. counted with GL_SAMPLES_PASSED
+// queries that are read back a few frames later like the profiler's timers. 1.0 means every pixel was shaded once
+class OverdrawCounter
+{
+public:
+    bool enabled = false;
+    // average of the frames read back since the last call to takeAverage
+    double overdraw = 0.0;
+
+    void create()
+    {
+        glGenQueries(PROFILER_QUERY_FRAMES, queries);
+    }
+
+    void release()
+    {
+        glDeleteQueries(PROFILER_QUERY_FRAMES, queries);
+    }
+
+    void setEnabled(bool value)
+    {
+        enabled = value;
+        for (bool &isPending : pending)
+        {
+            isPending = false;
+        }
+        sum = 0.0;
+        frames = 0;
+    }
+
+    void begin()
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        collect();
+        // a query still unread from PROFILER_QUERY_FRAMES frames ago is given up on
+        glBeginQuery(GL_SAMPLES_PASSED, queries[next]);
+    }
+
+    void end(int width, int height)
+    {
+        if (!enabled)
+        {
+            return;
+        }
+        glEndQuery(GL_SAMPLES_PASSED);
+        pending[next] = true;
+        pixels[next] = (double)width * height;
+        next = (next + 1) % PROFILER_QUERY_FRAMES;
+    }
+
+    // averages what was read back since the last call, for a once a second display
+    double takeAverage()
+    {
+        if (frames > 0)
+        {
+            overdraw = sum / frames;
+        }
+        sum = 0.0;
+        frames = 0;
+        return overdraw;
+    }
+
+private:
+    unsigned int queries[PROFILER_QUERY_FRAMES] = {};
+    bool pending[PROFILER_QUERY_FRAMES] = {};
+    double pixels[PROFILER_QUERY_FRAMES] = {};
+    int next = 0;
+    double sum = 0.0;
+    int frames = 0;
+
+    // oldest first, stops at the first query the GPU has not finished
+    void collect()
+    {
+        for (int i = 0; i < PROFILER_QUERY_FRAMES; i++)
+        {
+            int index = (next + i) % PROFILER_QUERY_FRAMES;
+            if (!pending[index])
+            {
+                continue;
+            }
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(queries[index], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                return;
+            }
+            GLuint64 samples = 0;
+            glGetQueryObjectui64v(queries[index], GL_QUERY_RESULT, &samples);
+            sum += samples / pixels[index];
+            frames++;
+            pending[index] = false;
+        }
+    }
+};
+
+// GPU time of whole frames, always on so the view distance sees frames that are bound by the GPU. the CPU only
+// waits for the GPU inside the swap, which is left out of the frame time for vsync. GL_TIMESTAMP counters are used
+// instead of GL_TIME_ELAPSED so they can run while the profiler's queries are active
+class GpuFrameTimer
+{
+public:
+    // the latest frame read back, a few frames old
+    double milliseconds = 0.0;
+
+    void create()
+    {
+        glGenQueries(PROFILER_QUERY_FRAMES * 2, &queries[0][0]);
+    }
+
+    void release()
+    {
+        glDeleteQueries(PROFILER_QUERY_FRAMES * 2, &queries[0][0]);
+    }
+
+    void begin()
+    {
+        collect();
+        // a pair still unread from PROFILER_QUERY_FRAMES frames ago is given up on
+        glQueryCounter(queries[next][0], GL_TIMESTAMP);
+    }
+
+    void end()
+    {
+        glQueryCounter(queries[next][1], GL_TIMESTAMP);
+        pending[next] = true;
+        next = (next + 1) % PROFILER_QUERY_FRAMES;
+    }
+
+private:
+    unsigned int queries[PROFILER_QUERY_FRAMES][2] = {};
+    bool pending[PROFILER_QUERY_FRAMES] = {};
+    int next = 0;
+
+    // oldest first, stops at the first frame the GPU has not finished
+    void collect()
+    {
+        for (int i = 0; i < PROFILER_QUERY_FRAMES; i++)
+        {
+            int index = (next + i) % PROFILER_QUERY_FRAMES;
+            if (!pending[index])
+            {
+                continue;
+            }
+            GLuint available = GL_FALSE;
+            glGetQueryObjectuiv(queries[index][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+            {
+                return;
+            }
+            GLuint64 start = 0, end = 0;
+            glGetQueryObjectui64v(queries[index][0], GL_QUERY_RESULT, &start);
+            glGetQueryObjectui64v(queries[index][1], GL_QUERY_RESULT, &end);
+            milliseconds = end > start ? (end - start) / 1e6 : 0.0;
+            pending[index] = false;
+        }
+    }
+};
+
+// times the enclosing block as one stage
+class ProfileScope
+{
+public:
+    ProfileScope(FrameProfiler &frameProfiler, ProfileStage profileStage, bool gpu = false) : profiler(frameProfiler), stage(profileStage)
+    {
+        profiler.beginStage(stage, gpu);
+    }
+
+    ~ProfileScope()
+    {
+        profiler.endStage(stage);
+    }
+
+    ProfileScope(const ProfileScope &) = delete;
+    ProfileScope &operator=(const ProfileScope &) = delete;
+
+private:
+    FrameProfiler &profiler;
+    ProfileStage stage;
+};
+
+#endif
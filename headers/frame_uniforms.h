@@ -0,0 +1,59 @@
+#ifndef FRAME_UNIFORMS_H
+#define FRAME_UNIFORMS_H
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "stream_buffer.h"
+
+using namespace std;
+
+// uniform block shared by every program, see the FrameData block in the shaders
+const char *const FRAME_UNIFORM_BLOCK = "FrameData";
+const unsigned int FRAME_UNIFORM_BINDING = 0;
+
+// std140 layout of FrameData. only mat4 and vec4 members, so the C++ layout matches without padding
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 projection;
+    glm::mat4 viewProjection;
+    // the view without its translation, the skybox stays around the camera
+    glm::mat4 skyboxViewProjection;
+    // w unused
+    glm::vec4 cameraPosition;
+    // position of the light the chunk meshes are baked with, w is the ambient light
+    glm::vec4 light;
+};
+
+// camera and lighting data of the current frame, written once per frame into the upload stream and bound from there
+// instead of setting the same uniforms on every program
+class FrameUniforms
+{
+public:
+    void create()
+    {
+        GLint alignment = 0;
+        glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        offsetAlignment = (size_t)std::max(alignment, 1);
+    }
+
+    void update(StreamBuffer &stream, const glm::mat4 &view, const glm::mat4 &projection, const glm::vec3 &cameraPosition, const glm::vec3 &lightPosition, float ambient)
+    {
+        FrameData data;
+        data.view = view;
+        data.projection = projection;
+        data.viewProjection = projection * view;
+        data.skyboxViewProjection = projection * glm::mat4(glm::mat3(view));
+        data.cameraPosition = glm::vec4(cameraPosition, 1.0f);
+        data.light = glm::vec4(lightPosition, ambient);
+        // the stream's fences keep earlier frames' data alive until the GPU is done with it
+        size_t offset = stream.upload(&data, sizeof(FrameData), offsetAlignment);
+        glBindBufferRange(GL_UNIFORM_BUFFER, FRAME_UNIFORM_BINDING, stream.buffer, (GLintptr)offset, sizeof(FrameData));
+    }
+
+private:
+    size_t offsetAlignment = 1;
+};
+
+#endif
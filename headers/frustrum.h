@@ -43,6 +43,30 @@ public:
         frontFace = front;
         rearFace = rear;
     }
+
+    // planes of the clip space box -w <= x, y, z <= w pulled back into world space (Gribb and Hartmann), so near, far
+    // and field of view always match the projection that is drawn with. normals point into the frustrum
+    static Frustrum fromViewProjection(const glm::mat4 &viewProjection)
+    {
+        // glm is column major, row i of the matrix is m[0][i], m[1][i], m[2][i], m[3][i]
+        auto row = [&](int i)
+        {
+            return glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+        };
+        auto plane = [](const glm::vec4 &coefficients)
+        {
+            float length = glm::length(glm::vec3(coefficients));
+            return Plane(glm::vec3(coefficients) / length, coefficients.w / length);
+        };
+        Frustrum frustrum;
+        frustrum.leftFace = plane(row(3) + row(0));
+        frustrum.rightFace = plane(row(3) - row(0));
+        frustrum.bottomFace = plane(row(3) + row(1));
+        frustrum.topFace = plane(row(3) - row(1));
+        frustrum.frontFace = plane(row(3) + row(2));
+        frustrum.rearFace = plane(row(3) - row(2));
+        return frustrum;
+    }
 };
 
 
@@ -0,0 +1,160 @@
+#ifndef FRUSTRUM_CULLING_H
+#define FRUSTRUM_CULLING_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include <initializer_list>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define FRUSTRUM_CULLING_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define FRUSTRUM_CULLING_NEON
+#endif
+
+#include "frustrum.h"
+
+using namespace std;
+
+// the 6 frustrum planes as separate arrays of their components, so one plane can be broadcast against many boxes
+struct FrustrumPlanes
+{
+    float normalX[6];
+    float normalY[6];
+    float normalZ[6];
+    float distance[6];
+
+    FrustrumPlanes(const Frustrum &frustrum)
+    {
+        const Plane *planes[6] = {&frustrum.frontFace, &frustrum.rearFace, &frustrum.leftFace,
+                                  &frustrum.rightFace, &frustrum.topFace, &frustrum.bottomFace};
+        for (int i = 0; i < 6; i++)
+        {
+            normalX[i] = planes[i]->normal.x;
+            normalY[i] = planes[i]->normal.y;
+            normalZ[i] = planes[i]->normal.z;
+            distance[i] = planes[i]->distance;
+        }
+    }
+};
+
+// axis aligned boxes stored one array per component, padded to a multiple of 4 so they can be tested 4 at a time
+class BoxCullList
+{
+public:
+    std::vector<float> minX, minY, minZ;
+    std::vector<float> maxX, maxY, maxZ;
+
+    size_t size() const
+    {
+        return count;
+    }
+
+    size_t paddedSize() const
+    {
+        return minX.size();
+    }
+
+    // returns the index of the new box
+    size_t add(const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+    {
+        size_t index = count++;
+        if (count > minX.size())
+        {
+            // the padding lanes are tested along with the rest, their results are never read
+            size_t paddedSize = (count + 3) & ~(size_t)3;
+            for (std::vector<float> *component : {&minX, &minY, &minZ, &maxX, &maxY, &maxZ})
+            {
+                component->resize(paddedSize, 0.0f);
+            }
+        }
+        set(index, boxMin, boxMax);
+        return index;
+    }
+
+    void set(size_t index, const glm::vec3 &boxMin, const glm::vec3 &boxMax)
+    {
+        minX[index] = boxMin.x;
+        minY[index] = boxMin.y;
+        minZ[index] = boxMin.z;
+        maxX[index] = boxMax.x;
+        maxY[index] = boxMax.y;
+        maxZ[index] = boxMax.z;
+    }
+
+    // writes 1 to visible[i] for every box that touches the frustrum and 0 for the rest. visible needs room for
+    // paddedSize() entries. a box is outside once its corner furthest along a plane normal is behind that plane, and
+    // since the plane is the same for all boxes that corner is picked once per plane instead of once per box
+    void cull(const FrustrumPlanes &planes, uint8_t *visible) const
+    {
+        const float *cornerX[6], *cornerY[6], *cornerZ[6];
+        for (int p = 0; p < 6; p++)
+        {
+            cornerX[p] = planes.normalX[p] >= 0.0f ? maxX.data() : minX.data();
+            cornerY[p] = planes.normalY[p] >= 0.0f ? maxY.data() : minY.data();
+            cornerZ[p] = planes.normalZ[p] >= 0.0f ? maxZ.data() : minZ.data();
+        }
+#if defined(FRUSTRUM_CULLING_SSE)
+        __m128 normalX[6], normalY[6], normalZ[6], distance[6];
+        for (int p = 0; p < 6; p++)
+        {
+            normalX[p] = _mm_set1_ps(planes.normalX[p]);
+            normalY[p] = _mm_set1_ps(planes.normalY[p]);
+            normalZ[p] = _mm_set1_ps(planes.normalZ[p]);
+            distance[p] = _mm_set1_ps(planes.distance[p]);
+        }
+#endif
+
+        for (size_t i = 0; i < paddedSize(); i += 4)
+        {
+            int outside = 0;
+#if defined(FRUSTRUM_CULLING_SSE)
+            __m128 behind = _mm_setzero_ps();
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 dot = _mm_add_ps(_mm_mul_ps(normalX[p], _mm_loadu_ps(cornerX[p] + i)), distance[p]);
+                dot = _mm_add_ps(dot, _mm_mul_ps(normalY[p], _mm_loadu_ps(cornerY[p] + i)));
+                dot = _mm_add_ps(dot, _mm_mul_ps(normalZ[p], _mm_loadu_ps(cornerZ[p] + i)));
+                behind = _mm_or_ps(behind, _mm_cmplt_ps(dot, _mm_setzero_ps()));
+            }
+            outside = _mm_movemask_ps(behind);
+#elif defined(FRUSTRUM_CULLING_NEON)
+            uint32x4_t behind = vdupq_n_u32(0);
+            for (int p = 0; p < 6; p++)
+            {
+                float32x4_t dot = vmlaq_n_f32(vdupq_n_f32(planes.distance[p]), vld1q_f32(cornerX[p] + i), planes.normalX[p]);
+                dot = vmlaq_n_f32(dot, vld1q_f32(cornerY[p] + i), planes.normalY[p]);
+                dot = vmlaq_n_f32(dot, vld1q_f32(cornerZ[p] + i), planes.normalZ[p]);
+                behind = vorrq_u32(behind, vcltq_f32(dot, vdupq_n_f32(0.0f)));
+            }
+            outside = (vgetq_lane_u32(behind, 0) & 1) | (vgetq_lane_u32(behind, 1) & 2) |
+                      (vgetq_lane_u32(behind, 2) & 4) | (vgetq_lane_u32(behind, 3) & 8);
+#else
+            for (int lane = 0; lane < 4; lane++)
+            {
+                for (int p = 0; p < 6; p++)
+                {
+                    float dot = planes.normalX[p] * cornerX[p][i + lane] + planes.normalY[p] * cornerY[p][i + lane] +
+                                planes.normalZ[p] * cornerZ[p][i + lane] + planes.distance[p];
+                    if (dot < 0.0f)
+                    {
+                        outside |= 1 << lane;
+                        break;
+                    }
+                }
+            }
+#endif
+            visible[i] = (outside & 1) == 0;
+            visible[i + 1] = (outside & 2) == 0;
+            visible[i + 2] = (outside & 4) == 0;
+            visible[i + 3] = (outside & 8) == 0;
+        }
+    }
+
+private:
+    size_t count = 0;
+};
+
+#endif
@@ -0,0 +1,126 @@
+#ifndef GL_EXTENSIONS_H
+#define GL_EXTENSIONS_H
+
+#include <glad/glad.h>
+#include <iostream>
+#include <cstring>
+
+using namespace std;
+
+// glad is generated for OpenGL 3.3 core only, so the newer entry points used when the driver offers them are
+// loaded here by hand. every feature has a fallback on plain 3.3, which is all mac os provides
+
+#ifndef GL_DRAW_INDIRECT_BUFFER
+#define GL_DRAW_INDIRECT_BUFFER 0x8F3F
+#endif
+
+#ifndef GL_MAP_PERSISTENT_BIT
+#define GL_MAP_PERSISTENT_BIT 0x0040
+#endif
+#ifndef GL_MAP_COHERENT_BIT
+#define GL_MAP_COHERENT_BIT 0x0080
+#endif
+
+#ifndef GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+#define GL_PROGRAM_BINARY_RETRIEVABLE_HINT 0x8257
+#endif
+#ifndef GL_PROGRAM_BINARY_LENGTH
+#define GL_PROGRAM_BINARY_LENGTH 0x8741
+#endif
+#ifndef GL_NUM_PROGRAM_BINARY_FORMATS
+#define GL_NUM_PROGRAM_BINARY_FORMATS 0x87FE
+#endif
+
+typedef void(APIENTRYP MultiDrawArraysIndirectProc)(GLenum mode, const void *indirect, GLsizei drawcount, GLsizei stride);
+typedef void(APIENTRYP BufferStorageProc)(GLenum target, GLsizeiptr size, const void *data, GLbitfield flags);
+typedef void(APIENTRYP GetProgramBinaryProc)(GLuint program, GLsizei bufSize, GLsizei *length, GLenum *binaryFormat, void *binary);
+typedef void(APIENTRYP ProgramBinaryProc)(GLuint program, GLenum binaryFormat, const void *binary, GLsizei length);
+typedef void(APIENTRYP ProgramParameteriProc)(GLuint program, GLenum pname, GLint value);
+typedef void(APIENTRYP MaxShaderCompilerThreadsProc)(GLuint count);
+
+struct GLExtensions
+{
+    // glMultiDrawArraysIndirect with base instances, core since 4.3
+    bool multiDrawIndirect = false;
+    MultiDrawArraysIndirectProc multiDrawArraysIndirect = nullptr;
+    // glBufferStorage for persistently mapped buffers, core since 4.4 and often there as ARB_buffer_storage before
+    bool persistentMapping = false;
+    BufferStorageProc bufferStorage = nullptr;
+    // linked programs saved and loaded as driver specific binaries, core since 4.1. only set when the driver
+    // offers at least one binary format, some report none
+    bool programBinaries = false;
+    GetProgramBinaryProc getProgramBinary = nullptr;
+    ProgramBinaryProc programBinary = nullptr;
+    ProgramParameteriProc programParameteri = nullptr;
+    // the driver compiles and links on its own threads, results are only waited for when they are queried
+    bool parallelShaderCompile = false;
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+};
+
+GLExtensions glExtensions;
+
+bool hasGLVersion(int major, int minor)
+{
+    return GLVersion.major > major || (GLVersion.major == major && GLVersion.minor >= minor);
+}
+
+bool hasGLExtension(const char *name)
+{
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (GLint i = 0; i < count; i++)
+    {
+        const char *extension = (const char *)glGetStringi(GL_EXTENSIONS, i);
+        if (extension != nullptr && strcmp(extension, name) == 0)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+// call once after glad, with the same loader
+void loadGLExtensions(GLADloadproc load)
+{
+    if (hasGLVersion(4, 3))
+    {
+        glExtensions.multiDrawArraysIndirect = (MultiDrawArraysIndirectProc)load("glMultiDrawArraysIndirect");
+        glExtensions.multiDrawIndirect = glExtensions.multiDrawArraysIndirect != nullptr;
+    }
+    if (hasGLVersion(4, 4) || hasGLExtension("GL_ARB_buffer_storage"))
+    {
+        glExtensions.bufferStorage = (BufferStorageProc)load("glBufferStorage");
+        glExtensions.persistentMapping = glExtensions.bufferStorage != nullptr;
+    }
+    if (hasGLVersion(4, 1) || hasGLExtension("GL_ARB_get_program_binary"))
+    {
+        glExtensions.getProgramBinary = (GetProgramBinaryProc)load("glGetProgramBinary");
+        glExtensions.programBinary = (ProgramBinaryProc)load("glProgramBinary");
+        glExtensions.programParameteri = (ProgramParameteriProc)load("glProgramParameteri");
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        glExtensions.programBinaries = glExtensions.getProgramBinary != nullptr && glExtensions.programBinary != nullptr &&
+                                       glExtensions.programParameteri != nullptr && formats > 0;
+    }
+    if (hasGLExtension("GL_KHR_parallel_shader_compile"))
+    {
+        glExtensions.maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsKHR");
+    }
+    else if (hasGLExtension("GL_ARB_parallel_shader_compile"))
+    {
+        glExtensions.maxShaderCompilerThreads = (MaxShaderCompilerThreadsProc)load("glMaxShaderCompilerThreadsARB");
+    }
+    if (glExtensions.maxShaderCompilerThreads != nullptr)
+    {
+        // let the driver pick how many threads it compiles on
+        glExtensions.maxShaderCompilerThreads(0xFFFFFFFF);
+        glExtensions.parallelShaderCompile = true;
+    }
+    cout << "OpenGL " << GLVersion.major << "." << GLVersion.minor
+         << (glExtensions.multiDrawIndirect ? ", multi draw indirect" : ", per chunk draws")
+         << (glExtensions.persistentMapping ? ", persistent mapped uploads" : ", orphaned uploads")
+         << (glExtensions.programBinaries ? ", program binary cache" : "")
+         << (glExtensions.parallelShaderCompile ? ", parallel shader compile" : "") << "\n";
+}
+
+#endif
@@ -0,0 +1,368 @@
+#ifndef INSTANCE_ARENA_H
+#define INSTANCE_ARENA_H
+
+#include <glad/glad.h>
+#include <map>
+#include <set>
+#include <vector>
+#include <utility>
+#include <cstddef>
+#include <cstdint>
+#include <algorithm>
+#include <iostream>
+
+#include "chunk_mesher.h"
+
+using namespace std;
+
+// instances of one slab buffer, a chunk's range never spans two slabs. larger ranges get a slab of their own size
+const unsigned int INSTANCE_SLAB_CAPACITY = 1 << 19;
+// ranges are rounded up to a size class, INSTANCE_SIZE_CLASS_STEPS classes per power of two from the smallest one
+const unsigned int INSTANCE_SIZE_CLASS_MIN = 64;
+const int INSTANCE_SIZE_CLASS_STEPS = 4;
+const int INSTANCE_SIZE_CLASS_COUNT = (32 - 6) * INSTANCE_SIZE_CLASS_STEPS;
+// ranges are moved out of the emptiest slab while less than this share of the slabs is in use
+const float INSTANCE_ARENA_COMPACT_OCCUPANCY = 0.5f;
+
+// range of FaceInstances inside one slab of the arena
+struct InstanceRange
+{
+    unsigned int slab = 0;
+    unsigned int first = 0;
+    unsigned int count = 0;
+};
+
+// how full the arena is. fragmentation is the share of the free space outside the largest hole, so 0 means all free
+// space is in one piece
+struct InstanceArenaStats
+{
+    unsigned int slabs = 0;
+    size_t capacity = 0;
+    size_t used = 0;
+    unsigned int holes = 0;
+    unsigned int largestHole = 0;
+
+    float occupancy() const
+    {
+        return capacity > 0 ? (float)used / capacity : 0.0f;
+    }
+
+    float fragmentation() const
+    {
+        size_t free = capacity - used;
+        return free > 0 ? 1.0f - (float)largestHole / free : 0.0f;
+    }
+
+    size_t bytes() const
+    {
+        return capacity * sizeof(FaceInstance);
+    }
+};
+
+// GPU memory for the face instances of every chunk, suballocated from slab buffers that are added as the loaded
+// world grows and released again once compaction has emptied them. free holes are binned by size class, so finding
+// a hole never scans the whole free list, and neighbouring holes of a slab merge
+class InstanceArena
+{
+public:
+    void create()
+    {
+        addSlab(INSTANCE_SLAB_CAPACITY);
+    }
+
+    void release()
+    {
+        for (auto &slab : slabs)
+        {
+            glDeleteBuffers(1, &slab.buffer);
+        }
+        slabs.clear();
+        for (auto &bin : bins)
+        {
+            bin.clear();
+        }
+    }
+
+    // the buffer to bind for the instances of a range in slab
+    unsigned int slabBuffer(unsigned int slab) const
+    {
+        return slabs[slab].buffer;
+    }
+
+    // the range may be larger than count, up to its size class
+    InstanceRange allocate(unsigned int count)
+    {
+        return allocateOutside(count, -1, true);
+    }
+
+    void free(const InstanceRange &range)
+    {
+        if (range.count == 0)
+        {
+            return;
+        }
+        Slab &slab = slabs[range.slab];
+        slab.used -= range.count;
+        unsigned int first = range.first, count = range.count;
+        // merge with the hole after it
+        auto next = slab.holes.lower_bound(first);
+        if (next != slab.holes.end() && first + count == next->first)
+        {
+            count += next->second;
+            next = removeHole(range.slab, next);
+        }
+        // and with the hole before it
+        if (next != slab.holes.begin())
+        {
+            auto previous = std::prev(next);
+            if (previous->first + previous->second == first)
+            {
+                first = previous->first;
+                count += previous->second;
+                removeHole(range.slab, previous);
+            }
+        }
+        addHole(range.slab, first, count);
+    }
+
+    // copies instances that were written to another buffer into an allocated range. the copy runs on the GPU, so
+    // it neither waits for draws still reading the arena nor for the source
+    void copyFrom(unsigned int sourceBuffer, size_t sourceOffset, const InstanceRange &range, unsigned int offset, unsigned int count)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, sourceBuffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slabs[range.slab].buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, sourceOffset, (GLintptr)(range.first + offset) * sizeof(FaceInstance), count * sizeof(FaceInstance));
+    }
+
+    // the slab to empty while the arena is mostly holes: the one with the fewest instances, when the other slabs have
+    // room for them. -1 when nothing needs compacting
+    int compactionSlab() const
+    {
+        InstanceArenaStats arenaStats = stats();
+        if (arenaStats.slabs < 2 || arenaStats.occupancy() >= INSTANCE_ARENA_COMPACT_OCCUPANCY)
+        {
+            return -1;
+        }
+        int emptiest = -1;
+        for (unsigned int i = 0; i < slabs.size(); i++)
+        {
+            if (slabs[i].capacity > 0 && slabs[i].used > 0 && (emptiest < 0 || slabs[i].used <= slabs[emptiest].used))
+            {
+                emptiest = (int)i;
+            }
+        }
+        if (emptiest < 0)
+        {
+            return -1;
+        }
+        size_t freeElsewhere = (arenaStats.capacity - arenaStats.used) - (slabs[emptiest].capacity - slabs[emptiest].used);
+        return freeElsewhere >= slabs[emptiest].used ? emptiest : -1;
+    }
+
+    // moves a range into another slab without adding one, copying its instances on the GPU. false when no other slab
+    // has a hole for it
+    bool moveRange(const InstanceRange &from, InstanceRange &to)
+    {
+        to = allocateOutside(from.count, (int)from.slab, false);
+        if (to.count == 0)
+        {
+            return false;
+        }
+        glBindBuffer(GL_COPY_READ_BUFFER, slabs[from.slab].buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slabs[to.slab].buffer);
+        glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, (GLintptr)from.first * sizeof(FaceInstance), (GLintptr)to.first * sizeof(FaceInstance), from.count * sizeof(FaceInstance));
+        free(from);
+        return true;
+    }
+
+    // deletes the buffers of empty slabs while the rest keep at least half a slab free, so a chunk loading right after
+    // does not need a new buffer straight away. GL keeps a deleted buffer alive until the draws reading it are done
+    void releaseEmptySlabs()
+    {
+        for (unsigned int i = 0; i < slabs.size(); i++)
+        {
+            Slab &slab = slabs[i];
+            if (slab.capacity == 0 || slab.used > 0)
+            {
+                continue;
+            }
+            InstanceArenaStats arenaStats = stats();
+            size_t freeElsewhere = (arenaStats.capacity - arenaStats.used) - slab.capacity;
+            if (arenaStats.slabs < 2 || freeElsewhere < INSTANCE_SLAB_CAPACITY / 2)
+            {
+                continue;
+            }
+            removeHole(i, slab.holes.begin());
+            glDeleteBuffers(1, &slab.buffer);
+            slab.buffer = 0;
+            slab.capacity = 0;
+        }
+    }
+
+    InstanceArenaStats stats() const
+    {
+        InstanceArenaStats arenaStats;
+        for (const auto &slab : slabs)
+        {
+            if (slab.capacity == 0)
+            {
+                continue;
+            }
+            arenaStats.slabs++;
+            arenaStats.capacity += slab.capacity;
+            arenaStats.used += slab.used;
+            arenaStats.holes += (unsigned int)slab.holes.size();
+            for (const auto &hole : slab.holes)
+            {
+                arenaStats.largestHole = std::max(arenaStats.largestHole, hole.second);
+            }
+        }
+        return arenaStats;
+    }
+
+private:
+    // a released slab keeps its place with no buffer and no capacity, so slab indices in ranges stay valid
+    struct Slab
+    {
+        unsigned int buffer = 0;
+        unsigned int capacity = 0;
+        unsigned int used = 0;
+        // free holes by first instance
+        std::map<unsigned int, unsigned int> holes;
+    };
+
+    std::vector<Slab> slabs;
+    // (slab, first instance) of every hole by the largest size class that fits in it, holes smaller than the
+    // smallest class are only kept for merging
+    std::set<std::pair<unsigned int, unsigned int>> bins[INSTANCE_SIZE_CLASS_COUNT];
+
+    static unsigned int classSize(int index)
+    {
+        uint64_t power = (uint64_t)INSTANCE_SIZE_CLASS_MIN << (index / INSTANCE_SIZE_CLASS_STEPS);
+        return (unsigned int)(power * (INSTANCE_SIZE_CLASS_STEPS + index % INSTANCE_SIZE_CLASS_STEPS) / INSTANCE_SIZE_CLASS_STEPS);
+    }
+
+    // smallest class that holds count instances
+    static int sizeClass(unsigned int count)
+    {
+        int index = 0;
+        while (classSize(index) < count)
+        {
+            index++;
+        }
+        return index;
+    }
+
+    // largest class that fits in a hole of size instances, -1 when none does
+    static int holeClass(unsigned int size)
+    {
+        if (size < INSTANCE_SIZE_CLASS_MIN)
+        {
+            return -1;
+        }
+        int index = 0;
+        while (index + 1 < INSTANCE_SIZE_CLASS_COUNT && classSize(index + 1) <= size)
+        {
+            index++;
+        }
+        return index;
+    }
+
+    void addHole(unsigned int slab, unsigned int first, unsigned int count)
+    {
+        slabs[slab].holes[first] = count;
+        int bin = holeClass(count);
+        if (bin >= 0)
+        {
+            bins[bin].insert({slab, first});
+        }
+    }
+
+    std::map<unsigned int, unsigned int>::iterator removeHole(unsigned int slab, std::map<unsigned int, unsigned int>::iterator hole)
+    {
+        int bin = holeClass(hole->second);
+        if (bin >= 0)
+        {
+            bins[bin].erase({slab, hole->first});
+        }
+        return slabs[slab].holes.erase(hole);
+    }
+
+    // takes the range from the lowest slab and offset of the first bin that fits, which keeps the later slabs
+    // emptier for compaction. a new slab is only added when grow is set
+    InstanceRange allocateOutside(unsigned int count, int excludedSlab, bool grow)
+    {
+        InstanceRange range;
+        if (count == 0)
+        {
+            return range;
+        }
+        int requestClass = sizeClass(count);
+        unsigned int size = classSize(requestClass);
+        for (int bin = requestClass; bin < INSTANCE_SIZE_CLASS_COUNT; bin++)
+        {
+            for (const auto &hole : bins[bin])
+            {
+                if ((int)hole.first != excludedSlab)
+                {
+                    return takeFromHole(hole.first, hole.second, size);
+                }
+            }
+        }
+        if (!grow)
+        {
+            return range;
+        }
+        unsigned int slab = addSlab(std::max(INSTANCE_SLAB_CAPACITY, size));
+        return takeFromHole(slab, 0, size);
+    }
+
+    InstanceRange takeFromHole(unsigned int slab, unsigned int first, unsigned int size)
+    {
+        auto hole = slabs[slab].holes.find(first);
+        unsigned int holeSize = hole->second;
+        removeHole(slab, hole);
+        if (holeSize > size)
+        {
+            addHole(slab, first + size, holeSize - size);
+        }
+        slabs[slab].used += size;
+        InstanceRange range;
+        range.slab = slab;
+        range.first = first;
+        range.count = size;
+        return range;
+    }
+
+    // reuses the place of a released slab if there is one
+    unsigned int addSlab(unsigned int capacity)
+    {
+        unsigned int index = 0;
+        while (index < slabs.size() && slabs[index].capacity > 0)
+        {
+            index++;
+        }
+        if (index == slabs.size())
+        {
+            slabs.emplace_back();
+        }
+        Slab &slab = slabs[index];
+        glGenBuffers(1, &slab.buffer);
+        glBindBuffer(GL_COPY_WRITE_BUFFER, slab.buffer);
+        glBufferData(GL_COPY_WRITE_BUFFER, (GLsizeiptr)capacity * sizeof(FaceInstance), nullptr, GL_STATIC_DRAW);
+        slab.capacity = capacity;
+        slab.used = 0;
+        addHole(index, 0, capacity);
+        if (index > 0)
+        {
+            cout << "Instance arena added a slab of " << capacity << " instances\n";
+        }
+        return index;
+    }
+};
+
+#endif
@@ -10,269 +10,829 @@
 #include <sstream>
 #include <iostream>
 #include <cstdlib>
+#include <chrono>
+#include <cstddef>
+#include <cmath>
+#include <climits>
+#include <memory>
+#include <algorithm>
 
 #include "chunk.h"
+#include "chunk_mesher.h"
 #include "block.h"
 #include "frustrum.h"
 #include "plane.h"
 #include "camera.h"
+#include "shader.h"
+#include "gl_extensions.h"
+#include "instance_arena.h"
+#include "stream_buffer.h"
+#include "frustrum_culling.h"
+#include "chunk_quadtree.h"
+#include "occlusion_culling.h"
 
 #include <unordered_set>
 
 using namespace std;
 
+// meshes are cached next to the other runtime data, relative to the working directory like shaders/ and graphics/
+const char *const MESH_CACHE_DIRECTORY = "cache/meshes";
+
+// render passes of a chunk mesh, matching the pass index used by writeQuadInstances
+const int MESH_PASS_OPAQUE = 0;
+const int MESH_PASS_TRANSPARENT = 1;
+const int MESH_PASS_COUNT = 2;
+
+// vertex attributes of FaceInstance in the world VAO, see texture.vs
+const int INSTANCE_QUAD_LOCATION = 3;
+const int INSTANCE_LIGHT_LOCATION = 4;
+
+// chunks that can have a mesh on the GPU at once, limited by the slot bits of FaceInstance::light
+const unsigned int MAX_CHUNK_SLOTS = 1u << FACE_INSTANCE_SLOT_BITS;
+// chunks compactArena moves to another arena slab per frame
+const int ARENA_COMPACTION_MOVES_PER_FRAME = 8;
+// texture unit of the chunk origin buffer texture, the block textures use unit 0
+const int CHUNK_ORIGIN_TEXTURE_UNIT = 1;
+// chunks up to MESH_LOD_DISTANCES[l] chunks from the camera's chunk (along x or z, whichever is further) are meshed
+// at level l or finer, chunks beyond the last distance at the coarsest level
+const int MESH_LOD_DISTANCES[MESH_LOD_COUNT - 1] = {2, 4, 6};
+
+// layout of glMultiDrawArraysIndirect commands
+struct DrawArraysIndirectCommand
+{
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int first;
+    unsigned int baseInstance;
+};
+
+// GPU copy of one chunk mesh. the instances of both passes live in one range of one instance arena slab that is
+// only written when the chunk is remeshed or moved by compactArena
+struct ChunkRenderData
+{
+    // index of the chunk's origin in the origin buffer, every instance carries it
+    unsigned int slot = 0;
+    // may be larger than the mesh so small edits to the chunk do not reallocate every time
+    InstanceRange range;
+    // group ranges index into the range's slab, transparent groups start after the opaque instances
+    std::vector<MeshGroup> groups[MESH_PASS_COUNT];
+    // every pass is one contiguous range of instances, drawn with a single call
+    unsigned int passFirst[MESH_PASS_COUNT] = {};
+    unsigned int passCount[MESH_PASS_COUNT] = {};
+    // where the chunk's world space bounding box lives in Mesh::cullTree, and its id in there
+    QuadtreeHandle cullHandle;
+    int cullId = -1;
+    // kept on the CPU for the occlusion culler
+    glm::vec3 origin = glm::vec3(0.0f);
+    glm::vec3 boundsMin = glm::vec3(0.0f);
+    glm::vec3 boundsMax = glm::vec3(0.0f);
+    uint8_t solidFloorHeights[SOLID_FLOOR_CELLS][SOLID_FLOOR_CELLS] = {};
+    // kept until the chunk is remeshed, so edits replace it along with the mesh
+    ChunkConnectivity connectivity;
+};
+
+// outcome of the last cullChunks and finishCulling. culled + unreachable + occluded + drawn is every chunk with a
+// mesh, tested counts the chunks that needed their own box test and nodesTested the quadtree regions
+struct ChunkCullStats
+{
+    int tested = 0;
+    int nodesTested = 0;
+    int culled = 0;
+    int unreachable = 0;
+    int occluded = 0;
+    int drawn = 0;
+};
+
+// worker time behind the meshes taken by the last uploadPendingMeshes, summed over all workers
+struct MeshWorkTimes
+{
+    double meshingMilliseconds = 0.0;
+    double instanceMilliseconds = 0.0;
+};
+
+// enables the FaceInstance attributes on the bound VAO, they advance once per instance
+void enableInstanceAttributes()
+{
+    glEnableVertexAttribArray(INSTANCE_QUAD_LOCATION);
+    glVertexAttribDivisor(INSTANCE_QUAD_LOCATION, 1);
+    glEnableVertexAttribArray(INSTANCE_LIGHT_LOCATION);
+    glVertexAttribDivisor(INSTANCE_LIGHT_LOCATION, 1);
+}
+
+// points the FaceInstance attributes at the instance buffer bound to GL_ARRAY_BUFFER, starting at firstInstance.
+// without base instances (GL 3.3) every draw of a sub range re-points the attributes instead. the attributes keep
+// reading the buffer that was bound when they were pointed, so they are pointed again for every slab
+void pointInstanceAttributes(size_t firstInstance)
+{
+    size_t base = firstInstance * sizeof(FaceInstance);
+    // both words stay packed integers, texture.vs unpacks them
+    glVertexAttribIPointer(INSTANCE_QUAD_LOCATION, 1, GL_UNSIGNED_INT, sizeof(FaceInstance), (void *)(base + offsetof(FaceInstance, quad)));
+    glVertexAttribIPointer(INSTANCE_LIGHT_LOCATION, 1, GL_UNSIGNED_INT, sizeof(FaceInstance), (void *)(base + offsetof(FaceInstance, light)));
+}
+
 class Mesh
 {
 public:
-    std::unordered_set<Block> renderOpaqueCubes;
-    std::unordered_set<Block> renderTransparentCubes;
-    std::unordered_map<glm::vec3, int> blockPositions;
+    // GPU buffers of the latest finished mesh of every chunk, keyed by chunk origin
+    std::unordered_map<glm::vec3, ChunkRenderData> chunkBuffers;
+    // chunks that passed the last cullChunks, pointing into chunkBuffers, nearest to the camera first
+    std::vector<const ChunkRenderData *> visibleChunks;
+    ChunkCullStats cullStats;
+    MeshWorkTimes workTimes;
 
-    Mesh(unordered_set<Chunk> chunks)
+    Mesh(const ChunkMap &chunks) : cache(MESH_CACHE_DIRECTORY), workers(&cache), cameraMasks(new BinaryMeshMasks())
     {
-        // insert blocks into set
-        for (const auto &chunk : chunks)
+        arena.create();
+        stream.create(STREAM_BUFFER_CAPACITY);
+        // the origins of all chunk slots, read by texture.vs through a buffer texture
+        glGenBuffers(1, &originBuffer);
+        glBindBuffer(GL_TEXTURE_BUFFER, originBuffer);
+        glBufferData(GL_TEXTURE_BUFFER, MAX_CHUNK_SLOTS * sizeof(glm::vec4), nullptr, GL_STATIC_DRAW);
+        glGenTextures(1, &originTexture);
+        glBindTexture(GL_TEXTURE_BUFFER, originTexture);
+        glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32F, originBuffer);
+        for (unsigned int slot = MAX_CHUNK_SLOTS; slot > 0; slot--)
+        {
+            freeSlots.push_back(slot - 1);
+        }
+
+        // mesh every chunk that is already loaded
+        for (const auto &pair : chunks)
         {
-            for (int i = 0; i < chunk.blocks.size(); i++)
+            queueChunk(chunks, pair.first);
+        }
+    }
+
+    void addChunksToMesh(const ChunkMap &chunks, const std::vector<glm::vec3> &newOrigins)
+    {
+        // new chunks change the borders of the chunks around them, so those are remeshed as well. coarse meshes do not
+        // look at their neighbours, see downsampleMeshMasks
+        std::unordered_set<glm::vec3> toMesh;
+        for (const auto &origin : newOrigins)
+        {
+            for (int dx = -1; dx <= 1; dx++)
             {
-                if (chunk.blocks.at(i).blockType != AIR)
+                for (int dz = -1; dz <= 1; dz++)
                 {
-                    blockPositions[chunk.blocks.at(i).blockPosition] = chunk.blocks.at(i).blockType;
+                    glm::vec3 neighbourOrigin = origin + glm::vec3(dx * (float)Chunk::CHUNK_SIZE, 0.0f, dz * (float)Chunk::CHUNK_SIZE);
+                    auto queuedLod = chunkLods.find(neighbourOrigin);
+                    bool isCoarse = queuedLod != chunkLods.end() && queuedLod->second > 0 && queuedLod->second == chunkLod(neighbourOrigin);
+                    if (chunks.find(neighbourOrigin) != chunks.end() && (neighbourOrigin == origin || !isCoarse))
+                    {
+                        toMesh.insert(neighbourOrigin);
+                    }
                 }
             }
-            for (int i = 0; i < chunk.trees.size(); i++)
+        }
+        for (const auto &origin : toMesh)
+        {
+            queueChunk(chunks, origin);
+        }
+    }
+
+    // uploads finished meshes from the workers into chunkBuffers until the time budget runs out
+    int uploadPendingMeshes(double budgetMilliseconds)
+    {
+        auto start = std::chrono::steady_clock::now();
+        int uploaded = 0;
+        workTimes = MeshWorkTimes();
+        ChunkMeshData meshData;
+        while (workers.tryPopResult(meshData))
+        {
+            workTimes.meshingMilliseconds += meshData.meshingMilliseconds;
+            workTimes.instanceMilliseconds += meshData.instanceMilliseconds;
+            // drop results that were superseded by a newer request for the same chunk
+            auto revision = latestRevision.find(meshData.origin);
+            if (revision != latestRevision.end() && revision->second == meshData.revision)
             {
-                if (chunk.trees.at(i).blockType != AIR)
+                if (uploadChunkMesh(meshData))
                 {
-                    blockPositions[chunk.trees.at(i).blockPosition] = chunk.trees.at(i).blockType;
+                    uploaded++;
                 }
             }
-            for (int i = 0; i < chunk.leaves.size(); i++)
+            // the GPU holds its own copy now, so the CPU buffers go back to the workers
+            workers.recycle(std::move(meshData));
+
+            std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+            if (elapsed.count() >= budgetMilliseconds)
             {
-                if (chunk.leaves.at(i).blockType != AIR)
-                {
-                    blockPositions[chunk.leaves.at(i).blockPosition] = chunk.leaves.at(i).blockType;
-                }
+                break;
             }
         }
+        return uploaded;
+    }
 
-        auto isMissingOrTransparent = [&](const glm::vec3 &checkPos)
+    // remeshes the chunks whose level of detail changed since the camera moved to another chunk. the levels only
+    // change when the camera crosses a chunk border, so chunks do not flip between two levels
+    void updateLevelsOfDetail(const ChunkMap &chunks, const glm::vec3 &cameraPosition)
+    {
+        glm::ivec2 center((int)std::floor(cameraPosition.x / Chunk::CHUNK_SIZE), (int)std::floor(cameraPosition.z / Chunk::CHUNK_SIZE));
+        if (center == lodCenter)
+        {
+            return;
+        }
+        lodCenter = center;
+        lodChanges.clear();
+        for (const auto &pair : chunkLods)
         {
-            auto it = blockPositions.find(checkPos);
-            if (it == blockPositions.end())
+            if (pair.second != chunkLod(pair.first))
             {
-                return true;
+                lodChanges.push_back(pair.first);
             }
-            return it->second == 5;
-        };
+        }
+        for (const auto &origin : lodChanges)
+        {
+            queueChunk(chunks, origin);
+        }
+    }
 
-        // Iterate again to determine visible blocks
-        for (const auto &chunk : chunks)
+    // finds the faces of the camera's chunk that the camera sees through open blocks, for cullChunks. the flood only
+    // runs again when the camera moves to another block or its chunk is remeshed
+    void updateCameraConnectivity(const ChunkMap &chunks, const glm::vec3 &cameraPosition)
+    {
+        const int size = Chunk::CHUNK_SIZE;
+        // block centers sit on whole coordinates
+        glm::ivec3 block = glm::ivec3(glm::floor(cameraPosition + 0.5f));
+        int chunkX = (int)std::floor((float)block.x / size);
+        int chunkZ = (int)std::floor((float)block.z / size);
+        glm::vec3 origin(chunkX * (float)size, 0.0f, chunkZ * (float)size);
+        auto revision = latestRevision.find(origin);
+        unsigned int chunkRevision = revision != latestRevision.end() ? revision->second : 0;
+        if (block == cameraBlock && chunkRevision == cameraRevision)
+        {
+            return;
+        }
+        cameraBlock = block;
+        cameraRevision = chunkRevision;
+        cameraChunkOrigin = origin;
+        cameraConnectivityValid = false;
+        // below the world or next to chunks that are not loaded yet nothing is culled
+        if (block.y < 0 || chunks.find(origin) == chunks.end())
+        {
+            return;
+        }
+        if (block.y >= MESH_HEIGHT)
+        {
+            // above every chunk, the camera looks in from the sky
+            cameraFaces = 1 << FACE_POS_Y;
+        }
+        else
+        {
+            fillBinaryMeshMasks(createChunkSnapshot(chunks, origin), *cameraMasks);
+            cameraFaces = openFacesFromBlock(*cameraMasks, block.x - chunkX * size, block.y, block.z - chunkZ * size);
+        }
+        // a camera inside a solid block sees no faces, culling would hide everything
+        cameraConnectivityValid = cameraFaces != 0;
+    }
+
+    // keeps the chunks whose bounding box touches the frustrum for drawChunks and counts what was culled.
+    // the quadtree accepts or rejects whole regions at once, only chunks in regions crossing the frustrum's border
+    // are tested one by one. chunks that no open path from the camera reaches are dropped next, and the rest are
+    // sorted front to back so near terrain fills the depth buffer before the terrain it hides is shaded.
+    // the survivors are then handed to the occlusion culler, which runs while the caller does other work until
+    // finishCulling
+    void cullChunks(const Frustrum &frustrum, const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition)
+    {
+        visibleChunks.clear();
+        visibleIds.clear();
+        cullTree.cull(FrustrumPlanes(frustrum), visibleIds);
+        cullStats.tested = cullTree.chunksTested;
+        cullStats.nodesTested = cullTree.nodesTested;
+        cullStats.culled = (int)(cullOwners.size() - freeCullIds.size() - visibleIds.size());
+        cullStats.unreachable = cullUnreachableChunks();
+        sortFrontToBack(cameraPosition);
+        cullStats.drawn = (int)visibleChunks.size();
+        cullStats.occluded = 0;
+
+        occlusionCandidates.clear();
+        for (const ChunkRenderData *renderData : visibleChunks)
         {
-            for (int i = 0; i < chunk.blocks.size(); i++)
+            occlusionCandidates.push_back(OcclusionBox{renderData->boundsMin, renderData->boundsMax});
+        }
+        collectOccluders();
+        occlusionCuller.submit(viewProjection, occluders, occlusionCandidates);
+        occlusionPending = true;
+    }
+
+    // waits for the occlusion culler and drops the chunks it found hidden from visibleChunks
+    void finishCulling()
+    {
+        if (!occlusionPending)
+        {
+            return;
+        }
+        occlusionPending = false;
+        occlusionCuller.wait(occlusionVisible);
+        size_t kept = 0;
+        for (size_t i = 0; i < visibleChunks.size(); i++)
+        {
+            if (occlusionVisible[i])
             {
-                if (chunk.blocks.at(i).blockType != AIR)
-                {
-                    const glm::vec3 &pos = chunk.blocks.at(i).blockPosition;
-
-                    if (
-                        isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1)))
-                    {
-                        renderOpaqueCubes.insert(chunk.blocks.at(i));
-                    }
-                }
+                visibleChunks[kept++] = visibleChunks[i];
             }
-            for (int i = 0; i < chunk.trees.size(); i++)
+        }
+        cullStats.occluded = (int)(visibleChunks.size() - kept);
+        cullStats.drawn = (int)kept;
+        visibleChunks.resize(kept);
+    }
+
+    // draws one pass of the chunks kept by the last cullChunks from the instance arena, with the world VAO, shader and
+    // block texture array bound. with GL 4.3 every run of consecutive chunks in the same arena slab is a single multi
+    // draw, otherwise every chunk is one instanced draw. opaque chunks are drawn front to back for early depth
+    // rejection, transparent ones back to front so they blend over what is behind them.
+    // returns the number of draw calls
+    int drawChunks(int pass)
+    {
+        glActiveTexture(GL_TEXTURE0 + CHUNK_ORIGIN_TEXTURE_UNIT);
+        glBindTexture(GL_TEXTURE_BUFFER, originTexture);
+        glActiveTexture(GL_TEXTURE0);
+
+        drawOrder.assign(visibleChunks.begin(), visibleChunks.end());
+        if (pass == MESH_PASS_TRANSPARENT)
+        {
+            std::reverse(drawOrder.begin(), drawOrder.end());
+        }
+
+        if (glExtensions.multiDrawIndirect)
+        {
+            // commands of a multi draw are executed in order. the order is kept across slabs too, a new run starts
+            // whenever the slab changes, so a single slab is a single run
+            drawCommands.clear();
+            drawRuns.clear();
+            for (const ChunkRenderData *renderData : drawOrder)
             {
-                if (chunk.trees.at(i).blockType != AIR)
+                if (renderData->passCount[pass] > 0)
                 {
-                    const glm::vec3 &pos = chunk.trees.at(i).blockPosition;
-
-                    // Check if block is exposed (i.e., it has at least one open face)
-                    if (
-                        isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1)))
+                    if (drawRuns.empty() || drawRuns.back().slab != renderData->range.slab)
                     {
-                        renderOpaqueCubes.insert(chunk.trees.at(i));
+                        drawRuns.push_back(DrawRun{renderData->range.slab, (unsigned int)drawCommands.size(), 0});
                     }
+                    drawRuns.back().count++;
+                    drawCommands.push_back(DrawArraysIndirectCommand{6, renderData->passCount[pass], 0, renderData->passFirst[pass]});
                 }
             }
-            for (int i = 0; i < chunk.leaves.size(); i++)
+            if (drawCommands.empty())
             {
-                if (chunk.leaves.at(i).blockType != AIR)
-                {
-                    const glm::vec3 &pos = chunk.leaves.at(i).blockPosition;
-
-                    // Check if block is exposed (i.e., it has at least one open face)
-                    if (
-                        isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1)))
-                    {
-                        renderTransparentCubes.insert(chunk.leaves.at(i));
-                    }
-                }
+                return 0;
             }
+            // the commands are read straight from the stream buffer, earlier frames' commands stay untouched there
+            size_t commandOffset = stream.upload(drawCommands.data(), drawCommands.size() * sizeof(DrawArraysIndirectCommand));
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, stream.buffer);
+            for (const DrawRun &run : drawRuns)
+            {
+                glBindBuffer(GL_ARRAY_BUFFER, arena.slabBuffer(run.slab));
+                pointInstanceAttributes(0);
+                glExtensions.multiDrawArraysIndirect(GL_TRIANGLES, (const void *)(commandOffset + run.first * sizeof(DrawArraysIndirectCommand)), (GLsizei)run.count, 0);
+            }
+            glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+            return (int)drawRuns.size();
+        }
+
+        int drawCalls = 0;
+        unsigned int boundSlab = UINT_MAX;
+        for (const ChunkRenderData *renderData : drawOrder)
+        {
+            if (renderData->passCount[pass] == 0)
+            {
+                continue;
+            }
+            if (renderData->range.slab != boundSlab)
+            {
+                boundSlab = renderData->range.slab;
+                glBindBuffer(GL_ARRAY_BUFFER, arena.slabBuffer(boundSlab));
+            }
+            pointInstanceAttributes(renderData->passFirst[pass]);
+            glDrawArraysInstanced(GL_TRIANGLES, 0, 6, renderData->passCount[pass]);
+            drawCalls++;
         }
+        return drawCalls;
     }
 
-    void addChunksToMesh(unordered_set<Chunk> chunks)
+    // moves a few chunks a frame out of the emptiest arena slab while the slabs are mostly holes, until it is empty
+    // and can be released. the copies run on the GPU in order with the draws, so nothing waits for them
+    void compactArena()
     {
-        // insert new blocks from new chunks into map
-        for (const auto &chunk : chunks)
+        arena.releaseEmptySlabs();
+        int slab = arena.compactionSlab();
+        if (slab < 0)
         {
-            for (int i = 0; i < chunk.blocks.size(); i++)
+            return;
+        }
+        int moved = 0;
+        for (auto &pair : chunkBuffers)
+        {
+            ChunkRenderData &renderData = pair.second;
+            if (renderData.range.count == 0 || (int)renderData.range.slab != slab)
             {
-                if (chunk.blocks.at(i).blockType != AIR)
-                {
-                    blockPositions[chunk.blocks.at(i).blockPosition] = chunk.blocks.at(i).blockType;
-                }
+                continue;
             }
-            for (int i = 0; i < chunk.trees.size(); i++)
+            InstanceRange target;
+            if (!arena.moveRange(renderData.range, target))
             {
-                if (chunk.trees.at(i).blockType != AIR)
-                {
-                    blockPositions[chunk.trees.at(i).blockPosition] = chunk.trees.at(i).blockType;
-                }
+                return;
             }
-            for (int i = 0; i < chunk.leaves.size(); i++)
+            for (int pass = 0; pass < MESH_PASS_COUNT; pass++)
             {
-                if (chunk.leaves[i].blockType != AIR)
+                for (auto &group : renderData.groups[pass])
                 {
-                    blockPositions[chunk.leaves.at(i).blockPosition] = chunk.leaves.at(i).blockType;
+                    group.first = group.first - renderData.range.first + target.first;
                 }
+                renderData.passFirst[pass] = renderData.passFirst[pass] - renderData.range.first + target.first;
+            }
+            renderData.range = target;
+            if (++moved == ARENA_COMPACTION_MOVES_PER_FRAME)
+            {
+                return;
             }
         }
+    }
 
-        auto isMissingOrTransparent = [&](const glm::vec3 &checkPos)
+    InstanceArenaStats arenaStats() const
+    {
+        return arena.stats();
+    }
+
+    // the ring every per frame upload goes through, fenced by finishFrame
+    StreamBuffer &uploadStream()
+    {
+        return stream;
+    }
+
+    // marks the end of the frame's uploads and draws, the stream buffer reuses their space once the GPU is past this
+    void finishFrame()
+    {
+        stream.fenceFrame();
+    }
+
+    // deletes the GPU buffers, must run while the GL context is still alive
+    void releaseBuffers()
+    {
+        finishCulling();
+        visibleChunks.clear();
+        cullTree.clear();
+        cullOwners.clear();
+        freeCullIds.clear();
+        arena.release();
+        stream.release();
+        glDeleteBuffers(1, &originBuffer);
+        glDeleteTextures(1, &originTexture);
+        chunkBuffers.clear();
+    }
+
+    // frees the slots, arena ranges and quadtree entries of unloaded chunks. their neighbours are not remeshed, chunks
+    // are only unloaded far enough out that the neighbours are coarse and never looked at them (see
+    // VIEW_DISTANCE_MIN). meshes still on the workers are dropped when they arrive
+    void removeChunksFromMesh(const std::vector<glm::vec3> &origins)
+    {
+        for (const auto &origin : origins)
         {
-            auto it = blockPositions.find(checkPos);
-            if (it == blockPositions.end())
+            // the revision keeps counting so a result meshed before the chunk was unloaded never matches a reload
+            latestRevision[origin]++;
+            chunkLods.erase(origin);
+            auto existing = chunkBuffers.find(origin);
+            if (existing == chunkBuffers.end())
             {
-                return true;
+                continue;
             }
-            return it->second == 5;
-        };
+            ChunkRenderData &renderData = existing->second;
+            arena.free(renderData.range);
+            freeSlots.push_back(renderData.slot);
+            cullTree.remove(renderData.cullHandle);
+            cullOwners[renderData.cullId] = nullptr;
+            freeCullIds.push_back(renderData.cullId);
+            chunkBuffers.erase(existing);
+        }
+        // may point at the erased chunks until the next cull
+        visibleChunks.clear();
+    }
+
+    // chunks queued for a mesh worker, being meshed or with a finished mesh still to upload
+    size_t pendingMeshes()
+    {
+        return workers.pendingJobs();
+    }
 
-        // Iterate again to determine visible blocks
-        for (const auto &chunk : chunks)
+private:
+    // declared before the workers so it outlives them
+    MeshCache cache;
+    MeshWorkerPool workers;
+    // revision of the most recent snapshot sent to the workers for each chunk
+    std::unordered_map<glm::vec3, unsigned int> latestRevision;
+    // level of detail of the most recent snapshot of each chunk, and the camera chunk the levels were picked for
+    std::unordered_map<glm::vec3, int> chunkLods;
+    glm::ivec2 lodCenter = glm::ivec2(0);
+    std::vector<glm::vec3> lodChanges;
+
+    InstanceArena arena;
+    // every upload to the arena, the origins and the indirect commands goes through here
+    StreamBuffer stream;
+    unsigned int originBuffer = 0;
+    unsigned int originTexture = 0;
+    std::vector<unsigned int> freeSlots;
+    // reused every frame so building the commands does not allocate
+    std::vector<DrawArraysIndirectCommand> drawCommands;
+    // commands of one multi draw, all reading the same slab
+    struct DrawRun
+    {
+        unsigned int slab;
+        unsigned int first;
+        unsigned int count;
+    };
+    std::vector<DrawRun> drawRuns;
+    // bounding boxes of all chunks with a mesh, ids in the tree index cullOwners. ids of unloaded chunks are null
+    // there and are handed out again from freeCullIds
+    ChunkQuadtree cullTree;
+    std::vector<const ChunkRenderData *> cullOwners;
+    std::vector<int> freeCullIds;
+    std::vector<int> visibleIds;
+    // the occlusion culler's inputs and result, reused every frame
+    OcclusionCuller occlusionCuller;
+    bool occlusionPending = false;
+    std::vector<OcclusionBox> occluders;
+    std::vector<OcclusionBox> occlusionCandidates;
+    std::vector<uint8_t> occlusionVisible;
+    // visibleChunks by distance while they are sorted, then in the order of the pass being drawn
+    std::vector<std::pair<float, const ChunkRenderData *>> chunkDistances;
+    std::vector<const ChunkRenderData *> drawOrder;
+    // the camera's block and what it sees of its chunk, see updateCameraConnectivity
+    std::unique_ptr<BinaryMeshMasks> cameraMasks;
+    glm::ivec3 cameraBlock = glm::ivec3(INT_MIN);
+    unsigned int cameraRevision = 0;
+    glm::vec3 cameraChunkOrigin = glm::vec3(0.0f);
+    uint8_t cameraFaces = 0;
+    bool cameraConnectivityValid = false;
+    // per cull id state of the connectivity walk, a chunk's entries only count when its frame matches cullFrame
+    unsigned int cullFrame = 0;
+    std::vector<unsigned int> walkFrames;
+    std::vector<uint8_t> walkEntries;
+    std::vector<uint8_t> walkExits;
+    std::vector<const ChunkRenderData *> walkQueue;
+
+    // walks from the camera's chunk into its neighbours through the faces that each chunk's open blocks connect,
+    // only stepping away from the camera and only into chunks that passed the frustrum. leaving any chunk through its
+    // top reaches the sky, from where every chunk can be entered through its top. chunks the walk never enters are
+    // hidden behind solid blocks, they are removed from visibleIds and counted.
+    // a chunk is drawn when it is entered at all, even through a face without open blocks, since that face is seen
+    int cullUnreachableChunks()
+    {
+        auto cameraChunk = chunkBuffers.find(cameraChunkOrigin);
+        if (!cameraConnectivityValid || cameraChunk == chunkBuffers.end())
+        {
+            return 0;
+        }
+        walkFrames.resize(cullOwners.size(), 0);
+        walkEntries.resize(cullOwners.size());
+        walkExits.resize(cullOwners.size());
+        cullFrame++;
+        for (int id : visibleIds)
+        {
+            walkFrames[id] = cullFrame;
+            walkEntries[id] = 0;
+            walkExits[id] = 0;
+        }
+
+        const int size = Chunk::CHUNK_SIZE;
+        int cameraX = (int)std::floor(cameraChunkOrigin.x / size);
+        int cameraZ = (int)std::floor(cameraChunkOrigin.z / size);
+        static const int steps[4][3] = {{FACE_NEG_Z, 0, -1}, {FACE_POS_Z, 0, 1}, {FACE_NEG_X, -1, 0}, {FACE_POS_X, 1, 0}};
+        bool skyReached = false;
+        walkQueue.clear();
+
+        auto enter = [&](const ChunkRenderData *chunk, int face)
+        {
+            int id = chunk->cullId;
+            if (walkFrames[id] != cullFrame || (walkEntries[id] & (1 << face)) != 0)
+            {
+                return;
+            }
+            walkEntries[id] |= 1 << face;
+            walkQueue.push_back(chunk);
+        };
+        auto leave = [&](const ChunkRenderData *chunk, uint8_t exits)
         {
-            for (int i = 0; i < chunk.blocks.size(); i++)
+            int chunkX = (int)std::floor(chunk->origin.x / size);
+            int chunkZ = (int)std::floor(chunk->origin.z / size);
+            for (const auto &step : steps)
             {
-                if (chunk.blocks.at(i).blockType != AIR)
+                // a line of sight never turns back towards the camera
+                bool awayFromCamera = step[1] != 0 ? (chunkX - cameraX) * step[1] >= 0 : (chunkZ - cameraZ) * step[2] >= 0;
+                if ((exits & (1 << step[0])) == 0 || !awayFromCamera)
                 {
-                    const glm::vec3 &pos = chunk.blocks.at(i).blockPosition;
-
-                    // Check if block is exposed (i.e., it has at least one open face)
-                    if (
-                        isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1)))
-                    {
-                        renderOpaqueCubes.insert(chunk.blocks.at(i));
-                    }
+                    continue;
+                }
+                glm::vec3 neighbourOrigin = chunk->origin + glm::vec3(step[1] * (float)size, 0.0f, step[2] * (float)size);
+                auto neighbour = chunkBuffers.find(neighbourOrigin);
+                if (neighbour != chunkBuffers.end())
+                {
+                    // the face of the neighbour opposite to the one left through, faces come in -/+ pairs
+                    enter(&neighbour->second, step[0] ^ 1);
                 }
             }
-            for (int i = 0; i < chunk.trees.size(); i++)
+            if (!skyReached && (exits & (1 << FACE_POS_Y)) != 0)
             {
-                if (chunk.trees.at(i).blockType != AIR)
+                skyReached = true;
+                for (int id : visibleIds)
                 {
-                    const glm::vec3 &pos = chunk.trees.at(i).blockPosition;
-
-                    // Check if block is exposed (i.e., it has at least one open face)
-                    if (
-                        isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1)))
-                    {
-                        renderOpaqueCubes.insert(chunk.trees.at(i));
-                    }
+                    enter(cullOwners[id], FACE_POS_Y);
                 }
             }
-            for (int i = 0; i < chunk.leaves.size(); i++)
+        };
+
+        // the camera's chunk is always drawn, even when the camera is above the frustrum culled part of it
+        const ChunkRenderData *start = &cameraChunk->second;
+        if (walkFrames[start->cullId] == cullFrame)
+        {
+            walkEntries[start->cullId] |= cameraFaces;
+            walkExits[start->cullId] = cameraFaces;
+        }
+        leave(start, cameraFaces);
+        for (size_t next = 0; next < walkQueue.size(); next++)
+        {
+            const ChunkRenderData *chunk = walkQueue[next];
+            int id = chunk->cullId;
+            uint8_t exits = 0;
+            for (int face = 0; face < FACE_COUNT; face++)
             {
-                if (chunk.leaves.at(i).blockType != AIR)
+                if ((walkEntries[id] & (1 << face)) != 0)
                 {
-                    const glm::vec3 &pos = chunk.leaves.at(i).blockPosition;
-
-                    // Check if block is exposed (i.e., it has at least one open face)
-                    if (
-                        isMissingOrTransparent(glm::vec3(pos.x + 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x - 1, pos.y, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y + 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y - 1, pos.z)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z + 1)) ||
-                        isMissingOrTransparent(glm::vec3(pos.x, pos.y, pos.z - 1)))
-                    {
-                        renderTransparentCubes.insert(chunk.leaves.at(i));
-                    }
+                    exits |= chunk->connectivity.faces[face];
                 }
             }
+            uint8_t newExits = exits & ~walkExits[id];
+            walkExits[id] |= newExits;
+            if (newExits != 0)
+            {
+                leave(chunk, newExits);
+            }
+        }
+
+        size_t kept = 0;
+        for (int id : visibleIds)
+        {
+            if (walkEntries[id] != 0)
+            {
+                visibleIds[kept++] = id;
+            }
+        }
+        int unreachable = (int)(visibleIds.size() - kept);
+        visibleIds.resize(kept);
+        return unreachable;
+    }
+
+    // fills visibleChunks with the chunks of visibleIds, ordered by the distance from the camera to the nearest point of
+    // their bounds so the chunk the camera is in always comes first
+    void sortFrontToBack(const glm::vec3 &cameraPosition)
+    {
+        chunkDistances.clear();
+        for (int id : visibleIds)
+        {
+            const ChunkRenderData *renderData = cullOwners[id];
+            glm::vec3 offset = glm::clamp(cameraPosition, renderData->boundsMin, renderData->boundsMax) - cameraPosition;
+            chunkDistances.push_back(std::make_pair(glm::dot(offset, offset), renderData));
+        }
+        std::sort(chunkDistances.begin(), chunkDistances.end(), [](const auto &a, const auto &b)
+                  { return a.first < b.first; });
+        for (const auto &pair : chunkDistances)
+        {
+            visibleChunks.push_back(pair.second);
         }
     }
 
-    void updateMesh(unordered_set<Chunk>& chunks, const Frustrum &frustrum)
+    // the solid floor boxes of the nearest frustrum visible chunks. far chunks cover few pixels and would mostly
+    // cost rasterization time, so only OCCLUSION_MAX_OCCLUDER_CHUNKS of them are used
+    void collectOccluders()
     {
-        // insert new blocks from new chunks into map
-        for (const auto &chunk : chunks)
+        // visibleChunks is sorted front to back, so the first chunks are the nearest
+        size_t occluderChunks = std::min(visibleChunks.size(), (size_t)OCCLUSION_MAX_OCCLUDER_CHUNKS);
+        occluders.clear();
+        for (size_t i = 0; i < occluderChunks; i++)
         {
-            if (isChunkInFrustrum(frustrum, chunk.origin, 40.0f)) {
-                cout << "true\n";
-            } else {
-                cout << "false\n";
+            const ChunkRenderData *renderData = visibleChunks[i];
+            for (int cellX = 0; cellX < SOLID_FLOOR_CELLS; cellX++)
+            {
+                for (int cellZ = 0; cellZ < SOLID_FLOOR_CELLS; cellZ++)
+                {
+                    int height = renderData->solidFloorHeights[cellX][cellZ];
+                    if (height == 0)
+                    {
+                        continue;
+                    }
+                    // block centers sit on whole coordinates, so the cell's blocks reach half a block past them
+                    glm::vec3 cellMin = renderData->origin + glm::vec3(cellX * SOLID_FLOOR_CELL - 0.5f, -0.5f, cellZ * SOLID_FLOOR_CELL - 0.5f);
+                    occluders.push_back(OcclusionBox{cellMin, cellMin + glm::vec3((float)SOLID_FLOOR_CELL, (float)height, (float)SOLID_FLOOR_CELL)});
+                }
             }
         }
     }
 
-    bool isChunkInFrustrum(const Frustrum &frustrum, const glm::vec3 &center, float radius)
+    // copies a finished mesh into the chunk's arena range, reusing the range when the new mesh fits.
+    // the instances are tagged with the chunk's slot while they are written to the stream buffer, and the GPU copies
+    // them on from there
+    bool uploadChunkMesh(const ChunkMeshData &meshData)
     {
-        Plane planes[6] = {
-            frustrum.frontFace,
-            frustrum.rearFace,
-            frustrum.leftFace,
-            frustrum.rightFace,
-            frustrum.topFace,
-            frustrum.bottomFace};
-
-        for (int i = 0; i < 6; i++)
-        {
-            // Dot product to check distance from the plane
-            // cout << center.x << center.y << center.z << "\n";
-            // cout << planes[i].normal.x << planes[i].normal.y << planes[i].normal.z << "\n"; 
-            float distance = glm::dot(planes[i].normal, center) + planes[i].distance;
-            if (distance < -radius)
+        auto existing = chunkBuffers.find(meshData.origin);
+        if (existing == chunkBuffers.end())
+        {
+            if (freeSlots.empty())
             {
-                // The cube is completely outside this plane
+                cerr << "Warning: no free chunk slot, chunk at " << meshData.origin.x << ", " << meshData.origin.z << " is not drawn\n";
                 return false;
             }
+            existing = chunkBuffers.emplace(meshData.origin, ChunkRenderData()).first;
+            existing->second.slot = freeSlots.back();
+            freeSlots.pop_back();
+            int chunkX = (int)std::floor(meshData.origin.x / Chunk::CHUNK_SIZE);
+            int chunkZ = (int)std::floor(meshData.origin.z / Chunk::CHUNK_SIZE);
+            if (freeCullIds.empty())
+            {
+                existing->second.cullId = (int)cullOwners.size();
+                cullOwners.push_back(&existing->second);
+            }
+            else
+            {
+                existing->second.cullId = freeCullIds.back();
+                freeCullIds.pop_back();
+                cullOwners[existing->second.cullId] = &existing->second;
+            }
+            existing->second.cullHandle = cullTree.insert(existing->second.cullId, chunkX, chunkZ, meshData.boundsMin, meshData.boundsMax);
+            glm::vec4 origin(meshData.origin, 0.0f);
+            size_t originOffset = stream.upload(&origin, sizeof(glm::vec4));
+            glBindBuffer(GL_COPY_READ_BUFFER, stream.buffer);
+            glBindBuffer(GL_COPY_WRITE_BUFFER, originBuffer);
+            glCopyBufferSubData(GL_COPY_READ_BUFFER, GL_COPY_WRITE_BUFFER, originOffset, existing->second.slot * sizeof(glm::vec4), sizeof(glm::vec4));
+        }
+        ChunkRenderData &renderData = existing->second;
+
+        unsigned int opaqueCount = (unsigned int)meshData.opaqueInstances.size();
+        unsigned int transparentCount = (unsigned int)meshData.transparentInstances.size();
+        unsigned int instanceCount = opaqueCount + transparentCount;
+        if (instanceCount > renderData.range.count)
+        {
+            arena.free(renderData.range);
+            // grow with some headroom so small edits to the chunk do not reallocate every time, the size class rounds
+            // it up further
+            renderData.range = arena.allocate(instanceCount + instanceCount / 8);
+        }
+
+        if (instanceCount > 0)
+        {
+            uint32_t slotBits = renderData.slot << FACE_INSTANCE_SLOT_SHIFT;
+            StreamRegion region = stream.map(instanceCount * sizeof(FaceInstance));
+            FaceInstance *staged = (FaceInstance *)region.data;
+            for (const auto &instance : meshData.opaqueInstances)
+            {
+                *staged++ = FaceInstance{instance.quad, instance.light | slotBits};
+            }
+            for (const auto &instance : meshData.transparentInstances)
+            {
+                *staged++ = FaceInstance{instance.quad, instance.light | slotBits};
+            }
+            stream.unmap();
+            arena.copyFrom(stream.buffer, region.offset, renderData.range, 0, instanceCount);
+        }
+
+        renderData.groups[MESH_PASS_OPAQUE] = meshData.opaqueGroups;
+        renderData.groups[MESH_PASS_TRANSPARENT] = meshData.transparentGroups;
+        for (auto &group : renderData.groups[MESH_PASS_OPAQUE])
+        {
+            group.first += renderData.range.first;
+        }
+        for (auto &group : renderData.groups[MESH_PASS_TRANSPARENT])
+        {
+            group.first += renderData.range.first + opaqueCount;
         }
+        renderData.passFirst[MESH_PASS_OPAQUE] = renderData.range.first;
+        renderData.passCount[MESH_PASS_OPAQUE] = opaqueCount;
+        renderData.passFirst[MESH_PASS_TRANSPARENT] = renderData.range.first + opaqueCount;
+        renderData.passCount[MESH_PASS_TRANSPARENT] = transparentCount;
+        cullTree.update(renderData.cullHandle, meshData.boundsMin, meshData.boundsMax);
+        renderData.origin = meshData.origin;
+        renderData.connectivity = meshData.connectivity;
+        renderData.boundsMin = meshData.boundsMin;
+        renderData.boundsMax = meshData.boundsMax;
+        std::copy(&meshData.solidFloorHeights[0][0], &meshData.solidFloorHeights[0][0] + SOLID_FLOOR_CELLS * SOLID_FLOOR_CELLS, &renderData.solidFloorHeights[0][0]);
         return true;
     }
 
-    void removeChunksFromMesh(unordered_set<Chunk> chunks)
+    // level of detail for the chunk at origin, by its distance from the camera's chunk
+    int chunkLod(const glm::vec3 &origin) const
     {
-        // logic to remove chunks outside of the frustrum
+        int distance = std::max(std::abs((int)std::floor(origin.x / Chunk::CHUNK_SIZE) - lodCenter.x), std::abs((int)std::floor(origin.z / Chunk::CHUNK_SIZE) - lodCenter.y));
+        int lod = 0;
+        while (lod < MESH_LOD_COUNT - 1 && distance > MESH_LOD_DISTANCES[lod])
+        {
+            lod++;
+        }
+        return lod;
     }
 
-private:
+    void queueChunk(const ChunkMap &chunks, const glm::vec3 &origin)
+    {
+        ChunkSnapshot snapshot = createChunkSnapshot(chunks, origin);
+        snapshot.revision = ++latestRevision[origin];
+        snapshot.lod = chunkLods[origin] = chunkLod(origin);
+        workers.submit(std::move(snapshot));
+    }
 };
 
 #endif
\ No newline at end of file
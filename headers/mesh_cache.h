@@ -0,0 +1,340 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <vector>
+#include <string>
+#include <iostream>
+#include <filesystem>
+#include <algorithm>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <cstdio>
+#include <cstdint>
+#include <cstdlib>
+#include <fcntl.h>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+#include "binary_mesher.h"
+
+using namespace std;
+
+// bump whenever the mesher output or the file layout changes so old entries are never read back
+const uint64_t MESH_CACHE_VERSION = 2;
+// oldest files are deleted once the cache holds more than this many meshes, at startup and as new meshes are stored
+const size_t MESH_CACHE_MAX_FILES = 20000;
+// open addressed slots of the key index, a power of two well above the file limit so probes stay short
+const size_t MESH_CACHE_INDEX_SLOTS = 1 << 16;
+static_assert(MESH_CACHE_INDEX_SLOTS >= 2 * MESH_CACHE_MAX_FILES, "the mesh cache index needs free slots to end probes");
+// room for the directory and a file name, paths are formatted into the stack so lookups never allocate
+const size_t MESH_CACHE_PATH_LENGTH = 512;
+
+// hash of everything the binary mesher reads: the chunk's blocks and the border of its neighbours
+uint64_t hashMeshMasks(const BinaryMeshMasks &masks)
+{
+    const uint64_t *words = reinterpret_cast<const uint64_t *>(&masks);
+    const size_t wordCount = sizeof(BinaryMeshMasks) / sizeof(uint64_t);
+    // FNV-1a over 64 bit words
+    uint64_t hash = 14695981039346656037ull ^ MESH_CACHE_VERSION ^ ((uint64_t)MESH_VERTEX_AO << 32);
+    for (size_t i = 0; i < wordCount; i++)
+    {
+        hash ^= words[i];
+        hash *= 1099511628211ull;
+    }
+    // final avalanche so nearby inputs do not end up with nearby file names
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// content addressed store of meshed quads on disk. a changed chunk hashes to a new key, so stale meshes are never used
+// and no explicit invalidation is needed. safe to use from all mesh workers at once. the index is allocated up front
+// and files go through plain descriptors, so loads and stores do not allocate. key 0 is never cached, it marks empty
+// index slots
+class MeshCache
+{
+public:
+    std::atomic<unsigned int> hits{0};
+    std::atomic<unsigned int> misses{0};
+
+    MeshCache(const std::string &cacheDirectory) : directory(cacheDirectory)
+    {
+        std::error_code error;
+        std::filesystem::create_directories(directory, error);
+        if (error)
+        {
+            cerr << "Failed to create mesh cache directory " << directory << ": " << error.message() << "\n";
+            enabled = false;
+            return;
+        }
+        if (directory.size() + 64 > MESH_CACHE_PATH_LENGTH)
+        {
+            cerr << "Mesh cache directory path is too long: " << directory << "\n";
+            enabled = false;
+            return;
+        }
+        indexSlots.assign(MESH_CACHE_INDEX_SLOTS, 0);
+        storedOrder.assign(MESH_CACHE_MAX_FILES, 0);
+        trimAndIndex();
+    }
+
+    bool load(uint64_t key, std::vector<MeshQuad> &quads)
+    {
+        {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            if (!enabled || key == 0 || !indexContains(key))
+            {
+                misses++;
+                return false;
+            }
+        }
+
+        char path[MESH_CACHE_PATH_LENGTH];
+        formatPath(path, key);
+        int file = open(path, O_RDONLY | O_BINARY);
+        if (file < 0)
+        {
+            misses++;
+            return false;
+        }
+        uint64_t header[2] = {0, 0};
+        uint32_t quadCount = 0;
+        bool valid = readAll(file, header, sizeof(header)) && readAll(file, &quadCount, sizeof(quadCount));
+        // a chunk can never produce more quads than it has block faces
+        const uint32_t maxQuads = MESH_AREA * MESH_AREA * MESH_HEIGHT * FACE_COUNT;
+        valid = valid && header[0] == MESH_CACHE_VERSION && header[1] == key && quadCount <= maxQuads;
+        if (valid)
+        {
+            quads.resize(quadCount);
+            valid = readAll(file, quads.data(), quadCount * sizeof(MeshQuad));
+        }
+        close(file);
+        if (!valid)
+        {
+            quads.clear();
+            misses++;
+            return false;
+        }
+        hits++;
+        return true;
+    }
+
+    void store(uint64_t key, const std::vector<MeshQuad> &quads)
+    {
+        if (!enabled || key == 0)
+        {
+            return;
+        }
+        char path[MESH_CACHE_PATH_LENGTH];
+        char temporaryPath[MESH_CACHE_PATH_LENGTH + 32];
+        formatPath(path, key);
+        // write to a temporary file first so a reader never sees a half written mesh
+        snprintf(temporaryPath, sizeof(temporaryPath), "%s.tmp%zx", path, std::hash<std::thread::id>()(std::this_thread::get_id()));
+        int file = open(temporaryPath, O_WRONLY | O_CREAT | O_TRUNC | O_BINARY, 0644);
+        if (file < 0)
+        {
+            return;
+        }
+        uint64_t header[2] = {MESH_CACHE_VERSION, key};
+        uint32_t quadCount = (uint32_t)quads.size();
+        bool written = writeAll(file, header, sizeof(header)) && writeAll(file, &quadCount, sizeof(quadCount)) &&
+                       writeAll(file, quads.data(), quads.size() * sizeof(MeshQuad));
+        close(file);
+        // rename does not replace an existing file on windows, which only happens when another worker stored the
+        // same mesh first
+        if (!written || std::rename(temporaryPath, path) != 0)
+        {
+            std::remove(temporaryPath);
+            return;
+        }
+
+        uint64_t evictedKey = 0;
+        {
+            std::lock_guard<std::mutex> lock(indexMutex);
+            evictedKey = remember(key);
+        }
+        // a worker still reading an evicted file just sees a miss
+        if (evictedKey != 0)
+        {
+            formatPath(path, evictedKey);
+            std::remove(path);
+        }
+    }
+
+private:
+    std::string directory;
+    bool enabled = true;
+    std::mutex indexMutex;
+    // keys of the meshes on disk by linear probing, so misses never touch the file system
+    std::vector<uint64_t> indexSlots;
+    // the same keys oldest first in a ring, so the cache can drop its oldest mesh when a store takes it over the limit
+    std::vector<uint64_t> storedOrder;
+    size_t orderFirst = 0;
+    size_t orderCount = 0;
+
+    void formatPath(char *path, uint64_t key) const
+    {
+        snprintf(path, MESH_CACHE_PATH_LENGTH, "%s/%016llx.mesh", directory.c_str(), (unsigned long long)key);
+    }
+
+    static bool readAll(int file, void *data, size_t size)
+    {
+        char *bytes = static_cast<char *>(data);
+        while (size > 0)
+        {
+            auto count = read(file, bytes, (unsigned int)std::min(size, (size_t)1 << 30));
+            if (count <= 0)
+            {
+                return false;
+            }
+            bytes += count;
+            size -= (size_t)count;
+        }
+        return true;
+    }
+
+    static bool writeAll(int file, const void *data, size_t size)
+    {
+        const char *bytes = static_cast<const char *>(data);
+        while (size > 0)
+        {
+            auto count = write(file, bytes, (unsigned int)std::min(size, (size_t)1 << 30));
+            if (count <= 0)
+            {
+                return false;
+            }
+            bytes += count;
+            size -= (size_t)count;
+        }
+        return true;
+    }
+
+    static size_t indexSlot(uint64_t key)
+    {
+        // the keys are already well mixed hashes
+        return (size_t)key & (MESH_CACHE_INDEX_SLOTS - 1);
+    }
+
+    bool indexContains(uint64_t key) const
+    {
+        for (size_t slot = indexSlot(key);; slot = (slot + 1) & (MESH_CACHE_INDEX_SLOTS - 1))
+        {
+            if (indexSlots[slot] == key)
+            {
+                return true;
+            }
+            if (indexSlots[slot] == 0)
+            {
+                return false;
+            }
+        }
+    }
+
+    // false when the key was already there
+    bool indexInsert(uint64_t key)
+    {
+        size_t slot = indexSlot(key);
+        while (indexSlots[slot] != 0)
+        {
+            if (indexSlots[slot] == key)
+            {
+                return false;
+            }
+            slot = (slot + 1) & (MESH_CACHE_INDEX_SLOTS - 1);
+        }
+        indexSlots[slot] = key;
+        return true;
+    }
+
+    // shifts the keys after the removed one back so no probe stops early at the hole
+    void indexErase(uint64_t key)
+    {
+        size_t hole = indexSlot(key);
+        while (indexSlots[hole] != key)
+        {
+            if (indexSlots[hole] == 0)
+            {
+                return;
+            }
+            hole = (hole + 1) & (MESH_CACHE_INDEX_SLOTS - 1);
+        }
+        indexSlots[hole] = 0;
+        for (size_t slot = (hole + 1) & (MESH_CACHE_INDEX_SLOTS - 1); indexSlots[slot] != 0; slot = (slot + 1) & (MESH_CACHE_INDEX_SLOTS - 1))
+        {
+            size_t home = indexSlot(indexSlots[slot]);
+            // the key may move into the hole when the hole lies between its home slot and where it sits now
+            if (((slot - home) & (MESH_CACHE_INDEX_SLOTS - 1)) >= ((slot - hole) & (MESH_CACHE_INDEX_SLOTS - 1)))
+            {
+                indexSlots[hole] = indexSlots[slot];
+                indexSlots[slot] = 0;
+                hole = slot;
+            }
+        }
+    }
+
+    // adds a stored key, returns the oldest key it pushed out of the cache or 0
+    uint64_t remember(uint64_t key)
+    {
+        if (!indexInsert(key))
+        {
+            return 0;
+        }
+        uint64_t evictedKey = 0;
+        if (orderCount == MESH_CACHE_MAX_FILES)
+        {
+            evictedKey = storedOrder[orderFirst];
+            indexErase(evictedKey);
+            orderFirst = (orderFirst + 1) % MESH_CACHE_MAX_FILES;
+            orderCount--;
+        }
+        storedOrder[(orderFirst + orderCount) % MESH_CACHE_MAX_FILES] = key;
+        orderCount++;
+        return evictedKey;
+    }
+
+    // indexes the meshes left by earlier runs and drops the oldest ones when the cache has grown too large
+    void trimAndIndex()
+    {
+        std::vector<std::pair<std::filesystem::file_time_type, std::filesystem::path>> files;
+        std::error_code error;
+        for (const auto &entry : std::filesystem::directory_iterator(directory, error))
+        {
+            if (entry.is_regular_file(error) && entry.path().extension() == ".mesh")
+            {
+                files.push_back(std::make_pair(entry.last_write_time(error), entry.path()));
+            }
+        }
+        std::sort(files.begin(), files.end());
+        if (files.size() > MESH_CACHE_MAX_FILES)
+        {
+            size_t removeCount = files.size() - MESH_CACHE_MAX_FILES;
+            for (size_t i = 0; i < removeCount; i++)
+            {
+                std::filesystem::remove(files[i].second, error);
+            }
+            files.erase(files.begin(), files.begin() + removeCount);
+        }
+        for (const auto &file : files)
+        {
+            std::string name = file.second.stem().string();
+            char *end = nullptr;
+            unsigned long long key = strtoull(name.c_str(), &end, 16);
+            if (end != name.c_str() && *end == '\0' && key != 0)
+            {
+                remember(key);
+            }
+        }
+    }
+};
+
+#endif
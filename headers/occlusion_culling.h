@@ -0,0 +1,402 @@
+#ifndef OCCLUSION_CULLING_H
+#define OCCLUSION_CULLING_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cfloat>
+
+#if defined(__SSE__) || defined(_M_X64) || defined(_M_IX86)
+#include <xmmintrin.h>
+#define OCCLUSION_CULLING_SSE
+#elif defined(__ARM_NEON)
+#include <arm_neon.h>
+#define OCCLUSION_CULLING_NEON
+#endif
+
+using namespace std;
+
+// resolution of the CPU depth buffer, the width is a multiple of 4 so every row splits into whole SSE lanes
+const int OCCLUSION_WIDTH = 160;
+const int OCCLUSION_HEIGHT = 120;
+// occluder boxes are only taken from this many of the nearest visible chunks
+const int OCCLUSION_MAX_OCCLUDER_CHUNKS = 64;
+
+struct OcclusionBox
+{
+    glm::vec3 boxMin;
+    glm::vec3 boxMax;
+};
+
+// small software depth buffer. occluder boxes are rasterized into it and chunk boxes are tested against it, which
+// needs no GPU queries and never stalls on the GPU. depth is stored as 1 / w, so larger is closer and 0 is empty
+class OcclusionRasterizer
+{
+public:
+    std::vector<float> depth;
+
+    OcclusionRasterizer() : depth(OCCLUSION_WIDTH * OCCLUSION_HEIGHT, 0.0f) {}
+
+    void clear(const glm::mat4 &newViewProjection)
+    {
+        viewProjection = newViewProjection;
+        std::fill(depth.begin(), depth.end(), 0.0f);
+    }
+
+    // rasterizes the faces of a box that is solid all the way through
+    void drawOccluder(const OcclusionBox &box)
+    {
+        glm::vec4 corners[8];
+        projectCorners(box, corners);
+        // corner i has x from bit 0, y from bit 1 and z from bit 2, every face winds clockwise seen from outside
+        static const int faces[6][4] = {
+            {0, 2, 6, 4}, {1, 5, 7, 3}, // -x, +x
+            {0, 4, 5, 1}, {2, 3, 7, 6}, // -y, +y
+            {0, 1, 3, 2}, {4, 6, 7, 5}, // -z, +z
+        };
+        for (const auto &face : faces)
+        {
+            glm::vec4 quad[4] = {corners[face[0]], corners[face[1]], corners[face[2]], corners[face[3]]};
+            drawClippedPolygon(quad, 4);
+        }
+    }
+
+    // false only when every depth buffer pixel the box covers holds an occluder strictly in front of the box
+    bool isBoxVisible(const OcclusionBox &box) const
+    {
+        glm::vec4 corners[8];
+        projectCorners(box, corners);
+        float minX = FLT_MAX, minY = FLT_MAX, maxX = -FLT_MAX, maxY = -FLT_MAX;
+        float nearest = 0.0f;
+        for (const auto &corner : corners)
+        {
+            // boxes reaching behind the camera are never culled
+            if (corner.w <= NEAR_W)
+            {
+                return true;
+            }
+            glm::vec2 screen = toScreen(corner);
+            minX = std::min(minX, screen.x);
+            minY = std::min(minY, screen.y);
+            maxX = std::max(maxX, screen.x);
+            maxY = std::max(maxY, screen.y);
+            nearest = std::max(nearest, 1.0f / corner.w);
+        }
+
+        // one pixel of margin, occluders only cover the pixels whose centers they contain
+        int x0 = std::max(0, (int)std::floor(minX) - 1);
+        int y0 = std::max(0, (int)std::floor(minY) - 1);
+        int x1 = std::min(OCCLUSION_WIDTH - 1, (int)std::floor(maxX) + 1);
+        int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)std::floor(maxY) + 1);
+        if (x0 > x1 || y0 > y1)
+        {
+            return true;
+        }
+        x0 &= ~3;
+        for (int y = y0; y <= y1; y++)
+        {
+            const float *row = &depth[y * OCCLUSION_WIDTH];
+#if defined(OCCLUSION_CULLING_SSE)
+            __m128 boxDepth = _mm_set1_ps(nearest);
+            for (int x = x0; x <= x1; x += 4)
+            {
+                // a pixel whose occluder is not in front of the box leaves it visible
+                if (_mm_movemask_ps(_mm_cmple_ps(_mm_loadu_ps(row + x), boxDepth)) != 0)
+                {
+                    return true;
+                }
+            }
+#elif defined(OCCLUSION_CULLING_NEON)
+            float32x4_t boxDepth = vdupq_n_f32(nearest);
+            for (int x = x0; x <= x1; x += 4)
+            {
+                uint32x4_t open = vcleq_f32(vld1q_f32(row + x), boxDepth);
+                uint32x2_t folded = vorr_u32(vget_low_u32(open), vget_high_u32(open));
+                if ((vget_lane_u32(folded, 0) | vget_lane_u32(folded, 1)) != 0)
+                {
+                    return true;
+                }
+            }
+#else
+            for (int x = x0; x <= x1; x++)
+            {
+                if (row[x] <= nearest)
+                {
+                    return true;
+                }
+            }
+#endif
+        }
+        return false;
+    }
+
+private:
+    // polygons are clipped to w >= NEAR_W so occluders crossing the camera plane still count
+    static constexpr float NEAR_W = 0.05f;
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+
+    void projectCorners(const OcclusionBox &box, glm::vec4 (&corners)[8]) const
+    {
+        for (int i = 0; i < 8; i++)
+        {
+            glm::vec3 corner((i & 1) ? box.boxMax.x : box.boxMin.x, (i & 2) ? box.boxMax.y : box.boxMin.y, (i & 4) ? box.boxMax.z : box.boxMin.z);
+            corners[i] = viewProjection * glm::vec4(corner, 1.0f);
+        }
+    }
+
+    static glm::vec2 toScreen(const glm::vec4 &clip)
+    {
+        return glm::vec2((clip.x / clip.w * 0.5f + 0.5f) * OCCLUSION_WIDTH, (clip.y / clip.w * 0.5f + 0.5f) * OCCLUSION_HEIGHT);
+    }
+
+    void drawClippedPolygon(const glm::vec4 *polygon, int count)
+    {
+        // clip against the w = NEAR_W plane, a quad gains at most one vertex
+        glm::vec4 clipped[8];
+        int clippedCount = 0;
+        for (int i = 0; i < count; i++)
+        {
+            const glm::vec4 &a = polygon[i];
+            const glm::vec4 &b = polygon[(i + 1) % count];
+            bool aInside = a.w >= NEAR_W, bInside = b.w >= NEAR_W;
+            if (aInside)
+            {
+                clipped[clippedCount++] = a;
+            }
+            if (aInside != bInside)
+            {
+                float t = (NEAR_W - a.w) / (b.w - a.w);
+                clipped[clippedCount++] = a + (b - a) * t;
+            }
+        }
+        if (clippedCount < 3)
+        {
+            return;
+        }
+
+        glm::vec3 screen[8];
+        for (int i = 0; i < clippedCount; i++)
+        {
+            screen[i] = glm::vec3(toScreen(clipped[i]), 1.0f / clipped[i].w);
+        }
+        for (int i = 1; i + 1 < clippedCount; i++)
+        {
+            drawTriangle(screen[0], screen[i], screen[i + 1]);
+        }
+    }
+
+    // x, y in depth buffer pixels and z = 1 / w, which is linear across the screen
+    void drawTriangle(glm::vec3 v0, glm::vec3 v1, glm::vec3 v2)
+    {
+        // occluder faces wind clockwise seen from outside, the back faces are hidden by the front faces of the same
+        // box and are skipped. the rest is flipped to counter clockwise so the edge functions are positive inside
+        float area = (v1.x - v0.x) * (v2.y - v0.y) - (v1.y - v0.y) * (v2.x - v0.x);
+        if (area > -1e-6f)
+        {
+            return;
+        }
+        std::swap(v1, v2);
+        area = -area;
+
+        int x0 = std::max(0, (int)std::floor(std::min({v0.x, v1.x, v2.x})));
+        int y0 = std::max(0, (int)std::floor(std::min({v0.y, v1.y, v2.y})));
+        int x1 = std::min(OCCLUSION_WIDTH - 1, (int)std::ceil(std::max({v0.x, v1.x, v2.x})));
+        int y1 = std::min(OCCLUSION_HEIGHT - 1, (int)std::ceil(std::max({v0.y, v1.y, v2.y})));
+        if (x0 > x1 || y0 > y1)
+        {
+            return;
+        }
+        x0 &= ~3;
+
+        // edge functions are positive inside, each steps by a constant per pixel in x and y
+        const glm::vec3 *edgeStart[3] = {&v0, &v1, &v2};
+        const glm::vec3 *edgeEnd[3] = {&v1, &v2, &v0};
+        float stepX[3], stepY[3], rowStart[3];
+        float startX = x0 + 0.5f, startY = y0 + 0.5f;
+        for (int e = 0; e < 3; e++)
+        {
+            const glm::vec3 &a = *edgeStart[e];
+            const glm::vec3 &b = *edgeEnd[e];
+            stepX[e] = -(b.y - a.y);
+            stepY[e] = b.x - a.x;
+            rowStart[e] = (b.x - a.x) * (startY - a.y) - (b.y - a.y) * (startX - a.x);
+        }
+        float depthStepX = ((v1.z - v0.z) * (v2.y - v0.y) - (v2.z - v0.z) * (v1.y - v0.y)) / area;
+        float depthStepY = ((v2.z - v0.z) * (v1.x - v0.x) - (v1.z - v0.z) * (v2.x - v0.x)) / area;
+        float depthRowStart = v0.z + depthStepX * (startX - v0.x) + depthStepY * (startY - v0.y);
+
+#if defined(OCCLUSION_CULLING_SSE)
+        const __m128 laneOffsets = _mm_set_ps(3.0f, 2.0f, 1.0f, 0.0f);
+        __m128 edgeLaneStep[3], edgeQuadStep[3];
+        for (int e = 0; e < 3; e++)
+        {
+            edgeLaneStep[e] = _mm_mul_ps(_mm_set1_ps(stepX[e]), laneOffsets);
+            edgeQuadStep[e] = _mm_set1_ps(stepX[e] * 4.0f);
+        }
+        __m128 depthLaneStep = _mm_mul_ps(_mm_set1_ps(depthStepX), laneOffsets);
+        __m128 depthQuadStep = _mm_set1_ps(depthStepX * 4.0f);
+        const __m128 zero = _mm_setzero_ps();
+
+        for (int y = y0; y <= y1; y++)
+        {
+            float rowOffset = (float)(y - y0);
+            __m128 edge0 = _mm_add_ps(_mm_set1_ps(rowStart[0] + stepY[0] * rowOffset), edgeLaneStep[0]);
+            __m128 edge1 = _mm_add_ps(_mm_set1_ps(rowStart[1] + stepY[1] * rowOffset), edgeLaneStep[1]);
+            __m128 edge2 = _mm_add_ps(_mm_set1_ps(rowStart[2] + stepY[2] * rowOffset), edgeLaneStep[2]);
+            __m128 pixelDepth = _mm_add_ps(_mm_set1_ps(depthRowStart + depthStepY * rowOffset), depthLaneStep);
+            float *row = &depth[y * OCCLUSION_WIDTH];
+            for (int x = x0; x <= x1; x += 4)
+            {
+                __m128 inside = _mm_and_ps(_mm_cmpge_ps(edge0, zero), _mm_and_ps(_mm_cmpge_ps(edge1, zero), _mm_cmpge_ps(edge2, zero)));
+                if (_mm_movemask_ps(inside) != 0)
+                {
+                    // keep the closest occluder, pixels outside the triangle compare against 0 and stay as they are
+                    __m128 current = _mm_loadu_ps(row + x);
+                    _mm_storeu_ps(row + x, _mm_max_ps(current, _mm_and_ps(inside, pixelDepth)));
+                }
+                edge0 = _mm_add_ps(edge0, edgeQuadStep[0]);
+                edge1 = _mm_add_ps(edge1, edgeQuadStep[1]);
+                edge2 = _mm_add_ps(edge2, edgeQuadStep[2]);
+                pixelDepth = _mm_add_ps(pixelDepth, depthQuadStep);
+            }
+        }
+#elif defined(OCCLUSION_CULLING_NEON)
+        const float laneValues[4] = {0.0f, 1.0f, 2.0f, 3.0f};
+        const float32x4_t laneOffsets = vld1q_f32(laneValues);
+        const float32x4_t zero = vdupq_n_f32(0.0f);
+        for (int y = y0; y <= y1; y++)
+        {
+            float rowOffset = (float)(y - y0);
+            float32x4_t edge0 = vmlaq_n_f32(vdupq_n_f32(rowStart[0] + stepY[0] * rowOffset), laneOffsets, stepX[0]);
+            float32x4_t edge1 = vmlaq_n_f32(vdupq_n_f32(rowStart[1] + stepY[1] * rowOffset), laneOffsets, stepX[1]);
+            float32x4_t edge2 = vmlaq_n_f32(vdupq_n_f32(rowStart[2] + stepY[2] * rowOffset), laneOffsets, stepX[2]);
+            float32x4_t pixelDepth = vmlaq_n_f32(vdupq_n_f32(depthRowStart + depthStepY * rowOffset), laneOffsets, depthStepX);
+            float *row = &depth[y * OCCLUSION_WIDTH];
+            for (int x = x0; x <= x1; x += 4)
+            {
+                uint32x4_t inside = vandq_u32(vcgeq_f32(edge0, zero), vandq_u32(vcgeq_f32(edge1, zero), vcgeq_f32(edge2, zero)));
+                float32x4_t covered = vreinterpretq_f32_u32(vandq_u32(inside, vreinterpretq_u32_f32(pixelDepth)));
+                vst1q_f32(row + x, vmaxq_f32(vld1q_f32(row + x), covered));
+                edge0 = vaddq_f32(edge0, vdupq_n_f32(stepX[0] * 4.0f));
+                edge1 = vaddq_f32(edge1, vdupq_n_f32(stepX[1] * 4.0f));
+                edge2 = vaddq_f32(edge2, vdupq_n_f32(stepX[2] * 4.0f));
+                pixelDepth = vaddq_f32(pixelDepth, vdupq_n_f32(depthStepX * 4.0f));
+            }
+        }
+#else
+        for (int y = y0; y <= y1; y++)
+        {
+            float rowOffset = (float)(y - y0);
+            float *row = &depth[y * OCCLUSION_WIDTH];
+            for (int x = x0; x <= x1; x++)
+            {
+                float columnOffset = (float)(x - x0);
+                bool inside = true;
+                for (int e = 0; e < 3; e++)
+                {
+                    inside = inside && rowStart[e] + stepY[e] * rowOffset + stepX[e] * columnOffset >= 0.0f;
+                }
+                if (inside)
+                {
+                    row[x] = std::max(row[x], depthRowStart + depthStepY * rowOffset + depthStepX * columnOffset);
+                }
+            }
+        }
+#endif
+    }
+};
+
+// runs the rasterizer on its own thread. the render thread hands over the frustrum culled chunks right after culling,
+// does other frame work and collects which of them are hidden just before drawing
+class OcclusionCuller
+{
+public:
+    OcclusionCuller() : worker(&OcclusionCuller::run, this) {}
+
+    ~OcclusionCuller()
+    {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        wake.notify_all();
+        worker.join();
+    }
+
+    // starts culling candidates against the occluders, both are copied so the caller may reuse its vectors. a job
+    // still running is waited for first, its result is then replaced by the new one
+    void submit(const glm::mat4 &viewProjection, const std::vector<OcclusionBox> &occluders, const std::vector<OcclusionBox> &candidates)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]
+                  { return isDone; });
+        jobViewProjection = viewProjection;
+        jobOccluders = occluders;
+        jobCandidates = candidates;
+        hasJob = true;
+        isDone = false;
+        wake.notify_all();
+    }
+
+    // blocks until the last submitted job is finished, visible[i] belongs to candidate i
+    void wait(std::vector<uint8_t> &visible)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        done.wait(lock, [&]
+                  { return isDone; });
+        visible = jobVisible;
+    }
+
+private:
+    OcclusionRasterizer rasterizer;
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable done;
+    bool hasJob = false;
+    bool isDone = true;
+    bool stopping = false;
+    glm::mat4 jobViewProjection;
+    std::vector<OcclusionBox> jobOccluders;
+    std::vector<OcclusionBox> jobCandidates;
+    std::vector<uint8_t> jobVisible;
+    // started last so every member above exists before the thread does
+    std::thread worker;
+
+    void run()
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true)
+        {
+            wake.wait(lock, [&]
+                      { return hasJob || stopping; });
+            if (stopping)
+            {
+                return;
+            }
+            hasJob = false;
+            // submit waits for isDone before it writes the job and wait only reads jobVisible once isDone is set, so
+            // the worker owns the job vectors until then and the lock can be dropped while working
+            lock.unlock();
+            rasterizer.clear(jobViewProjection);
+            for (const auto &occluder : jobOccluders)
+            {
+                rasterizer.drawOccluder(occluder);
+            }
+            jobVisible.resize(jobCandidates.size());
+            for (size_t i = 0; i < jobCandidates.size(); i++)
+            {
+                jobVisible[i] = rasterizer.isBoxVisible(jobCandidates[i]);
+            }
+            lock.lock();
+            isDone = true;
+            done.notify_all();
+        }
+    }
+};
+
+#endif
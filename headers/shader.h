@@ -7,6 +7,11 @@
 #include <fstream>
 #include <sstream>
 #include <iostream>
+#include <unordered_map>
+
+#include "frame_uniforms.h"
+#include "gl_extensions.h"
+#include "shader_cache.h"
 
 using namespace std;
 
@@ -15,7 +20,7 @@ class Shader
     public:
     // the program ID
     unsigned int ID;
-    // constructor reads and builds the shader
+    // constructor reads the shader and starts building it, from the program binary cache when it has a match
     Shader(const char* vertexPath, const char* fragmentPath) {
         string vertexCode;
         string fragmentCode;
@@ -42,90 +47,187 @@ class Shader
         catch(std::ifstream::failure e) {
             cout << "EROR::SHADER:FILE_NOT_SUCCESSFULLY_READ\n";
         }
-        const char* vShaderCode = vertexCode.c_str();
-        const char* fShaderCode = fragmentCode.c_str();
 
-        unsigned int vertex, fragment;
-        // vertex Shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-
-        // similar for fragment shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // shader Program
         ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-
-        // delete vetex and fragment shaders
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
+        programKey = hashShaderProgram(vertexCode, fragmentCode);
+        loadedFromCache = loadProgramBinary(ID, programKey);
+        if (!loadedFromCache) {
+            compileAndLink(vertexCode, fragmentCode);
+        }
+        else {
+            // kept in case the driver turns the cached binary down
+            pendingVertexCode = vertexCode;
+            pendingFragmentCode = fragmentCode;
+        }
     };
+    // waits for the program, then checks it for errors and caches its binary and uniforms. with parallel shader
+    // compile the driver builds on its own threads, so programs created one after another compile side by side until
+    // each is first used
+    void finishLinking() {
+        if (linked) {
+            return;
+        }
+        linked = true;
+        if (loadedFromCache) {
+            int success = 0;
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
+            if (!success) {
+                // binaries go stale with driver updates the version string does not show, compile like before
+                loadedFromCache = false;
+                glDeleteProgram(ID);
+                ID = glCreateProgram();
+                compileAndLink(pendingVertexCode, pendingFragmentCode);
+            }
+            pendingVertexCode.clear();
+            pendingFragmentCode.clear();
+        }
+        if (!loadedFromCache) {
+            checkCompileErrors(vertexShader, "VERTEX");
+            checkCompileErrors(fragmentShader, "FRAGMENT");
+            checkCompileErrors(ID, "PROGRAM");
+
+            // delete vetex and fragment shaders
+            glDetachShader(ID, vertexShader);
+            glDetachShader(ID, fragmentShader);
+            glDeleteShader(vertexShader);
+            glDeleteShader(fragmentShader);
+
+            int success = 0;
+            glGetProgramiv(ID, GL_LINK_STATUS, &success);
+            if (success) {
+                storeProgramBinary(ID, programKey);
+            }
+        }
+
+        cacheUniformLocations();
+        // every program that declares the per frame block reads it from the same buffer
+        unsigned int frameBlock = glGetUniformBlockIndex(ID, FRAME_UNIFORM_BLOCK);
+        if (frameBlock != GL_INVALID_INDEX) {
+            glUniformBlockBinding(ID, frameBlock, FRAME_UNIFORM_BINDING);
+        }
+    }
     // use/activate the shader
     void use() 
     { 
+        finishLinking();
         glUseProgram(ID); 
     }
+    // location of a uniform resolved at link time, -1 when the program has no such uniform. glUniform ignores -1
+    // just like it did when the location was looked up on every call
+    int uniformLocation(const std::string &name) const {
+        auto location = uniformLocations.find(name);
+        return location != uniformLocations.end() ? location->second : -1;
+    }
     // utility uniform functions
     void setBool(const std::string &name, bool value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()),(int)value);
+        glUniform1i(uniformLocation(name),(int)value);
     }
     void setInt(const std::string &name, int value) const {
-        glUniform1i(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1i(uniformLocation(name), value);
     }
     void setFloat(const std::string &name, float value) const {
-        glUniform1f(glGetUniformLocation(ID, name.c_str()), value);
+        glUniform1f(uniformLocation(name), value);
     }
     void setVec2(const std::string &name, const glm::vec2 &value) const
     { 
-        glUniform2fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform2fv(uniformLocation(name), 1, &value[0]); 
     }
     void setVec2(const std::string &name, float x, float y) const
     { 
-        glUniform2f(glGetUniformLocation(ID, name.c_str()), x, y); 
+        glUniform2f(uniformLocation(name), x, y); 
     }
     // ------------------------------------------------------------------------
     void setVec3(const std::string &name, const glm::vec3 &value) const
     { 
-        glUniform3fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform3fv(uniformLocation(name), 1, &value[0]); 
     }
     void setVec3(const std::string &name, float x, float y, float z) const
     { 
-        glUniform3f(glGetUniformLocation(ID, name.c_str()), x, y, z); 
+        glUniform3f(uniformLocation(name), x, y, z); 
     }
     // ------------------------------------------------------------------------
     void setVec4(const std::string &name, const glm::vec4 &value) const
     { 
-        glUniform4fv(glGetUniformLocation(ID, name.c_str()), 1, &value[0]); 
+        glUniform4fv(uniformLocation(name), 1, &value[0]); 
     }
     void setVec4(const std::string &name, float x, float y, float z, float w) const
     { 
-        glUniform4f(glGetUniformLocation(ID, name.c_str()), x, y, z, w); 
+        glUniform4f(uniformLocation(name), x, y, z, w); 
     }
     // ------------------------------------------------------------------------
     void setMat2(const std::string &name, const glm::mat2 &mat) const
     {
-        glUniformMatrix2fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix2fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat3(const std::string &name, const glm::mat3 &mat) const
     {
-        glUniformMatrix3fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix3fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
     // ------------------------------------------------------------------------
     void setMat4(const std::string &name, const glm::mat4 &mat) const
     {
-        glUniformMatrix4fv(glGetUniformLocation(ID, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+        glUniformMatrix4fv(uniformLocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // whether the program came from the program binary cache instead of being compiled, known once linked
+    bool loadedFromCache = false;
+
 private:
+    std::unordered_map<std::string, int> uniformLocations;
+    uint64_t programKey = 0;
+    bool linked = false;
+    unsigned int vertexShader = 0;
+    unsigned int fragmentShader = 0;
+    string pendingVertexCode;
+    string pendingFragmentCode;
+
+    // starts compiling and linking without asking for the result, which would wait for the driver
+    void compileAndLink(const string &vertexCode, const string &fragmentCode) {
+        const char* vShaderCode = vertexCode.c_str();
+        const char* fShaderCode = fragmentCode.c_str();
+
+        // vertex Shader
+        vertexShader = glCreateShader(GL_VERTEX_SHADER);
+        glShaderSource(vertexShader, 1, &vShaderCode, NULL);
+        glCompileShader(vertexShader);
+
+        // similar for fragment shader
+        fragmentShader = glCreateShader(GL_FRAGMENT_SHADER);
+        glShaderSource(fragmentShader, 1, &fShaderCode, NULL);
+        glCompileShader(fragmentShader);
+        // shader Program
+        glAttachShader(ID, vertexShader);
+        glAttachShader(ID, fragmentShader);
+        if (glExtensions.programBinaries) {
+            glExtensions.programParameteri(ID, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        }
+        glLinkProgram(ID);
+    }
+
+    // asks the linked program for all of its active uniforms once, so setting one never goes back to the driver
+    void cacheUniformLocations() {
+        int count = 0;
+        glGetProgramiv(ID, GL_ACTIVE_UNIFORMS, &count);
+        for (int i = 0; i < count; i++) {
+            char name[256];
+            int length = 0, size = 0;
+            GLenum type;
+            glGetActiveUniform(ID, i, sizeof(name), &length, &size, &type, name);
+            int location = glGetUniformLocation(ID, name);
+            // members of uniform blocks have no location
+            if (location < 0) {
+                continue;
+            }
+            std::string uniformName(name, length);
+            uniformLocations[uniformName] = location;
+            // arrays are reported as name[0], but set by their plain name
+            if (uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+                uniformLocations[uniformName.substr(0, uniformName.size() - 3)] = location;
+            }
+        }
+    }
+
     // utility function for checking shader/sompilation/linking errors
     //----------------------------------------------------------------
     void checkCompileErrors(unsigned int shader, string type) {
@@ -0,0 +1,141 @@
+#ifndef SHADER_CACHE_H
+#define SHADER_CACHE_H
+
+#include <glad/glad.h>
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <cstdio>
+#include <cstdint>
+
+#include "gl_extensions.h"
+
+using namespace std;
+
+// linked programs are cached next to the meshes, relative to the working directory like shaders/
+const char *const SHADER_CACHE_DIRECTORY = "cache/shaders";
+// bump whenever the file layout changes so old entries are never read back
+const uint64_t SHADER_CACHE_VERSION = 1;
+// no program binary comes anywhere near this, larger sizes mean a damaged file
+const uint32_t SHADER_CACHE_MAX_BINARY = 64 << 20;
+
+uint64_t hashShaderText(uint64_t hash, const char *text)
+{
+    // FNV-1a, the terminating zero is hashed too so neighbouring strings cannot run into each other
+    for (const char *c = text != nullptr ? text : ""; ; c++)
+    {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ull;
+        if (*c == '\0')
+        {
+            return hash;
+        }
+    }
+}
+
+// key of a program: its sources and the driver that compiled it, a binary is only valid for the exact same driver
+uint64_t hashShaderProgram(const std::string &vertexCode, const std::string &fragmentCode)
+{
+    uint64_t hash = 14695981039346656037ull ^ SHADER_CACHE_VERSION;
+    hash = hashShaderText(hash, vertexCode.c_str());
+    hash = hashShaderText(hash, fragmentCode.c_str());
+    hash = hashShaderText(hash, (const char *)glGetString(GL_VENDOR));
+    hash = hashShaderText(hash, (const char *)glGetString(GL_RENDERER));
+    hash = hashShaderText(hash, (const char *)glGetString(GL_VERSION));
+    return hash;
+}
+
+std::string shaderCachePath(uint64_t key)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.program", (unsigned long long)key);
+    return std::string(SHADER_CACHE_DIRECTORY) + "/" + name;
+}
+
+// loads a cached binary into program. false when there is none, the caller then compiles from source. the driver
+// may still reject a binary it wrote itself, which shows up as a failed link status afterwards
+bool loadProgramBinary(unsigned int program, uint64_t key)
+{
+    if (!glExtensions.programBinaries)
+    {
+        return false;
+    }
+    std::ifstream file(shaderCachePath(key), std::ios::binary);
+    if (!file)
+    {
+        return false;
+    }
+    uint64_t header[2] = {0, 0};
+    uint32_t format = 0, length = 0;
+    file.read(reinterpret_cast<char *>(header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&format), sizeof(format));
+    file.read(reinterpret_cast<char *>(&length), sizeof(length));
+    if (!file || header[0] != SHADER_CACHE_VERSION || header[1] != key || length == 0 || length > SHADER_CACHE_MAX_BINARY)
+    {
+        return false;
+    }
+    std::vector<char> binary(length);
+    file.read(binary.data(), length);
+    if (!file)
+    {
+        return false;
+    }
+    glExtensions.programBinary(program, format, binary.data(), (GLsizei)length);
+    return true;
+}
+
+// writes a linked program to the cache. the program must have been linked with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+void storeProgramBinary(unsigned int program, uint64_t key)
+{
+    if (!glExtensions.programBinaries)
+    {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0 || (uint32_t)length > SHADER_CACHE_MAX_BINARY)
+    {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    GLsizei written = 0;
+    glExtensions.getProgramBinary(program, length, &written, &format, binary.data());
+    if (written <= 0)
+    {
+        return;
+    }
+
+    std::error_code error;
+    std::filesystem::create_directories(SHADER_CACHE_DIRECTORY, error);
+    if (error)
+    {
+        cerr << "Failed to create shader cache directory " << SHADER_CACHE_DIRECTORY << ": " << error.message() << "\n";
+        return;
+    }
+    std::string path = shaderCachePath(key);
+    // write to a temporary file first so a half written binary is never loaded
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        uint64_t header[2] = {SHADER_CACHE_VERSION, key};
+        uint32_t storedFormat = format, storedLength = (uint32_t)written;
+        file.write(reinterpret_cast<const char *>(header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&storedFormat), sizeof(storedFormat));
+        file.write(reinterpret_cast<const char *>(&storedLength), sizeof(storedLength));
+        file.write(binary.data(), written);
+        if (!file)
+        {
+            std::remove(temporaryPath.c_str());
+            return;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporaryPath.c_str());
+    }
+}
+
+#endif
@@ -0,0 +1,199 @@
+#ifndef STREAM_BUFFER_H
+#define STREAM_BUFFER_H
+
+#include <glad/glad.h>
+#include <deque>
+#include <cstring>
+#include <cstddef>
+#include <algorithm>
+#include <iostream>
+
+#include "gl_extensions.h"
+
+using namespace std;
+
+// bytes of upload data that can be in flight at once, a few frames of chunk meshes while the world loads
+const size_t STREAM_BUFFER_CAPACITY = 16 << 20;
+// every region starts on this boundary, which satisfies GL_MIN_MAP_BUFFER_ALIGNMENT and the indirect command layout
+const size_t STREAM_BUFFER_ALIGNMENT = 64;
+
+// place in the stream buffer that an upload was written to
+struct StreamRegion
+{
+    void *data = nullptr;
+    size_t offset = 0;
+};
+
+// ring buffer that the CPU writes uploads into and the GPU copies or reads them from, so an upload never waits for
+// the GPU to finish with the destination buffer. every frame's part of the ring is guarded by a fence that is only
+// waited for when the ring wraps around onto it, and the storage never changes, so a range of it can stay bound
+// for the whole frame. with glBufferStorage the ring is mapped once, persistently and coherently, without it every
+// region is mapped unsynchronized on its own
+class StreamBuffer
+{
+public:
+    unsigned int buffer = 0;
+    size_t capacity = 0;
+
+    void create(size_t size)
+    {
+        capacity = size;
+        glGenBuffers(1, &buffer);
+        glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+        if (glExtensions.persistentMapping)
+        {
+            GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glExtensions.bufferStorage(GL_COPY_READ_BUFFER, capacity, nullptr, flags);
+            persistentData = (char *)glMapBufferRange(GL_COPY_READ_BUFFER, 0, capacity, flags);
+            if (persistentData == nullptr)
+            {
+                // the storage is immutable now, so the mutable kind needs a new buffer
+                cerr << "Failed to map the stream buffer persistently, mapping every upload instead\n";
+                glDeleteBuffers(1, &buffer);
+                glGenBuffers(1, &buffer);
+                glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            }
+        }
+        if (persistentData == nullptr)
+        {
+            glBufferData(GL_COPY_READ_BUFFER, capacity, nullptr, GL_STREAM_DRAW);
+        }
+        head = 0;
+        frameStart = 0;
+    }
+
+    void release()
+    {
+        for (const auto &segment : inFlight)
+        {
+            glDeleteSync(segment.fence);
+        }
+        inFlight.clear();
+        if (persistentData != nullptr)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+            persistentData = nullptr;
+        }
+        glDeleteBuffers(1, &buffer);
+        buffer = 0;
+        capacity = 0;
+    }
+
+    // reserves size bytes starting on a multiple of alignment, which must be a power of two, and returns where to
+    // write them. the region stays mapped until unmap, which must come before any GL call reads it
+    StreamRegion map(size_t size, size_t alignment = STREAM_BUFFER_ALIGNMENT)
+    {
+        if (size > capacity)
+        {
+            // only a single enormous upload gets here, the old storage is left to the driver like an orphan
+            size_t newCapacity = capacity * 2;
+            while (newCapacity < size)
+            {
+                newCapacity *= 2;
+            }
+            release();
+            create(newCapacity);
+            cout << "Stream buffer grown to " << (newCapacity >> 20) << " MB\n";
+        }
+
+        alignment = std::max(alignment, STREAM_BUFFER_ALIGNMENT);
+        size_t offset = (head + alignment - 1) & ~(alignment - 1);
+        if (offset + size > capacity)
+        {
+            wrap();
+            offset = 0;
+        }
+        head = offset + size;
+
+        StreamRegion region;
+        region.offset = offset;
+        waitForRegion(offset, offset + size);
+        if (persistentData != nullptr)
+        {
+            region.data = persistentData + offset;
+        }
+        else
+        {
+            // the fences keep the GPU off the region, so the driver need not synchronize
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            region.data = glMapBufferRange(GL_COPY_READ_BUFFER, offset, size, GL_MAP_WRITE_BIT | GL_MAP_UNSYNCHRONIZED_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            mappedRange = true;
+        }
+        return region;
+    }
+
+    void unmap()
+    {
+        if (mappedRange)
+        {
+            glBindBuffer(GL_COPY_READ_BUFFER, buffer);
+            glUnmapBuffer(GL_COPY_READ_BUFFER);
+            mappedRange = false;
+        }
+    }
+
+    // copies data into the ring and returns its offset there
+    size_t upload(const void *data, size_t size, size_t alignment = STREAM_BUFFER_ALIGNMENT)
+    {
+        StreamRegion region = map(size, alignment);
+        memcpy(region.data, data, size);
+        unmap();
+        return region.offset;
+    }
+
+    // call once all of the frame's GL commands that read from the ring are issued
+    void fenceFrame()
+    {
+        fenceSegment();
+    }
+
+private:
+    struct Segment
+    {
+        size_t start;
+        size_t end;
+        GLsync fence;
+    };
+    // fenced parts of the ring that the GPU may still read from, oldest first
+    std::deque<Segment> inFlight;
+    char *persistentData = nullptr;
+    bool mappedRange = false;
+    size_t head = 0;
+    // start of the part of the ring written since the last fence
+    size_t frameStart = 0;
+
+    void fenceSegment()
+    {
+        if (head > frameStart)
+        {
+            inFlight.push_back(Segment{frameStart, head, glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0)});
+        }
+        frameStart = head;
+    }
+
+    void wrap()
+    {
+        // the current frame's part gets its own fence so the writes after the wrap cannot run into it
+        fenceSegment();
+        head = 0;
+        frameStart = 0;
+    }
+
+    // the ring is written in order, so the oldest segments are the ones in the way of new writes
+    void waitForRegion(size_t start, size_t end)
+    {
+        while (!inFlight.empty() && inFlight.front().start < end && start < inFlight.front().end)
+        {
+            GLenum result;
+            do
+            {
+                result = glClientWaitSync(inFlight.front().fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            } while (result == GL_TIMEOUT_EXPIRED);
+            glDeleteSync(inFlight.front().fence);
+            inFlight.pop_front();
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,376 @@
+#ifndef TEXTURE_PACK_H
+#define TEXTURE_PACK_H
+
+#include <vector>
+#include <string>
+#include <fstream>
+#include <iostream>
+#include <filesystem>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <iterator>
+#include <cstdio>
+#include <cstdint>
+#include <cstring>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#include "stb_image.h"
+#include "block_textures.h"
+
+using namespace std;
+
+// block textures and skybox with their mips, decoded ahead of time by tools/pack_textures.cpp
+const char *const TEXTURE_PACK_PATH = "graphics/textures.pack";
+const uint32_t TEXTURE_PACK_MAGIC = 0x4b415054; // "TPAK"
+// bump whenever the file layout changes so old packs are never read back
+const uint32_t TEXTURE_PACK_VERSION = 1;
+
+const char *const SKYBOX_FACES[6] = {
+    "graphics/skybox_1/0.png",
+    "graphics/skybox_1/1.png",
+    "graphics/skybox_1/2.png",
+    "graphics/skybox_1/3.png",
+    "graphics/skybox_1/4.png",
+    "graphics/skybox_1/5.png",
+};
+
+// down to 1x1
+const int BLOCK_TEXTURE_MIP_LEVELS = 10;
+static_assert((BLOCK_TEXTURE_SIZE >> (BLOCK_TEXTURE_MIP_LEVELS - 1)) == 1, "BLOCK_TEXTURE_MIP_LEVELS must reach 1x1");
+
+// the file starts with this header, followed by every mip level of the block textures from the largest down, all
+// layers of a level one after another, then the 6 skybox faces. all texels are RGBA8, rows bottom up like GL wants
+// them for the block textures and top down for the skybox faces
+struct TexturePackHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t blockSize;
+    uint32_t blockLayers;
+    uint32_t blockMipLevels;
+    uint32_t skyboxSize;
+    uint64_t fileSize;
+};
+
+// RGBA8 texels of one image
+struct DecodedImage
+{
+    int width = 0;
+    int height = 0;
+    std::vector<unsigned char> texels;
+};
+
+// source images of the block texture layers, in layer order
+std::vector<std::string> blockTexturePaths()
+{
+    std::vector<std::string> paths;
+    for (int blockType = 1; blockType < BLOCK_TYPE_COUNT; blockType++)
+    {
+        for (int variant = 0; variant < BLOCK_TEXTURE_VARIANTS; variant++)
+        {
+            paths.push_back(string(BLOCK_TEXTURE_FOLDERS[blockType]) + "/" + to_string(variant) + ".png");
+        }
+    }
+    return paths;
+}
+
+// decodes the images on worker threads, failed ones are left empty. the first flippedCount images are flipped so
+// their first row is the bottom one like the block textures need, the rest (cubemap faces) are not
+void decodeImages(const std::vector<std::string> &paths, size_t flippedCount, std::vector<DecodedImage> &images)
+{
+    images.assign(paths.size(), DecodedImage());
+    std::atomic<size_t> next{0};
+    auto decode = [&]()
+    {
+        for (size_t i = next++; i < paths.size(); i = next++)
+        {
+            // the flip flag of stb_image is global unless it is set per thread
+            stbi_set_flip_vertically_on_load_thread(i < flippedCount);
+            int width, height, channels;
+            unsigned char *data = stbi_load(paths[i].c_str(), &width, &height, &channels, 4);
+            if (data == nullptr)
+            {
+                continue;
+            }
+            images[i].width = width;
+            images[i].height = height;
+            images[i].texels.assign(data, data + (size_t)width * height * 4);
+            stbi_image_free(data);
+        }
+    };
+    unsigned int threadCount = std::max(1u, std::min(std::thread::hardware_concurrency(), (unsigned int)paths.size()));
+    std::vector<std::thread> workers;
+    for (unsigned int i = 1; i < threadCount; i++)
+    {
+        workers.emplace_back(decode);
+    }
+    decode();
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+}
+
+// all block textures followed by the skybox faces, decoded in one batch so the workers stay busy
+void decodeTextureSources(std::vector<DecodedImage> &blocks, std::vector<DecodedImage> &skybox)
+{
+    std::vector<std::string> paths = blockTexturePaths();
+    size_t blockCount = paths.size();
+    paths.insert(paths.end(), SKYBOX_FACES, SKYBOX_FACES + 6);
+    decodeImages(paths, blockCount, blocks);
+    skybox.assign(std::make_move_iterator(blocks.begin() + blockCount), std::make_move_iterator(blocks.end()));
+    blocks.resize(blockCount);
+}
+
+// next mip level of a square RGBA8 image, every texel the average of the 2x2 texels above it
+void downsampleTexels(const unsigned char *source, int size, unsigned char *destination)
+{
+    int half = size / 2;
+    for (int y = 0; y < half; y++)
+    {
+        const unsigned char *row0 = source + (size_t)(2 * y) * size * 4;
+        const unsigned char *row1 = row0 + (size_t)size * 4;
+        for (int x = 0; x < half; x++)
+        {
+            for (int channel = 0; channel < 4; channel++)
+            {
+                int sum = row0[8 * x + channel] + row0[8 * x + 4 + channel] + row1[8 * x + channel] + row1[8 * x + 4 + channel];
+                destination[((size_t)y * half + x) * 4 + channel] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    }
+}
+
+size_t blockLevelBytes(int level)
+{
+    size_t size = BLOCK_TEXTURE_SIZE >> level;
+    return size * size * 4 * BLOCK_TEXTURE_LAYERS;
+}
+
+// decodes all source images and writes the pack, false after reporting what was wrong with them
+bool writeTexturePack(const std::string &path)
+{
+    std::vector<DecodedImage> blocks, skybox;
+    decodeTextureSources(blocks, skybox);
+    std::vector<std::string> blockPaths = blockTexturePaths();
+    for (size_t i = 0; i < blocks.size(); i++)
+    {
+        if (blocks[i].width != BLOCK_TEXTURE_SIZE || blocks[i].height != BLOCK_TEXTURE_SIZE)
+        {
+            cerr << "Block texture " << blockPaths[i] << " is missing or not " << BLOCK_TEXTURE_SIZE << "x" << BLOCK_TEXTURE_SIZE << "\n";
+            return false;
+        }
+    }
+    int skyboxSize = skybox[0].width;
+    for (size_t i = 0; i < skybox.size(); i++)
+    {
+        if (skybox[i].width == 0 || skybox[i].width != skyboxSize || skybox[i].height != skyboxSize)
+        {
+            cerr << "Skybox face " << SKYBOX_FACES[i] << " is missing or not the same square size as the others\n";
+            return false;
+        }
+    }
+
+    TexturePackHeader header;
+    header.magic = TEXTURE_PACK_MAGIC;
+    header.version = TEXTURE_PACK_VERSION;
+    header.blockSize = BLOCK_TEXTURE_SIZE;
+    header.blockLayers = BLOCK_TEXTURE_LAYERS;
+    header.blockMipLevels = BLOCK_TEXTURE_MIP_LEVELS;
+    header.skyboxSize = skyboxSize;
+    header.fileSize = sizeof(TexturePackHeader) + (size_t)skyboxSize * skyboxSize * 4 * 6;
+    for (int level = 0; level < BLOCK_TEXTURE_MIP_LEVELS; level++)
+    {
+        header.fileSize += blockLevelBytes(level);
+    }
+
+    // write to a temporary file first so a half written pack is never loaded
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        std::vector<unsigned char> level, nextLevel;
+        for (const auto &block : blocks)
+        {
+            level.insert(level.end(), block.texels.begin(), block.texels.end());
+        }
+        for (int levelIndex = 0; levelIndex < BLOCK_TEXTURE_MIP_LEVELS; levelIndex++)
+        {
+            file.write(reinterpret_cast<const char *>(level.data()), level.size());
+            int size = BLOCK_TEXTURE_SIZE >> levelIndex;
+            if (size == 1)
+            {
+                break;
+            }
+            nextLevel.resize(blockLevelBytes(levelIndex + 1));
+            size_t layerBytes = (size_t)size * size * 4, nextLayerBytes = layerBytes / 4;
+            for (int layer = 0; layer < BLOCK_TEXTURE_LAYERS; layer++)
+            {
+                downsampleTexels(level.data() + layer * layerBytes, size, nextLevel.data() + layer * nextLayerBytes);
+            }
+            level.swap(nextLevel);
+        }
+        for (const auto &face : skybox)
+        {
+            file.write(reinterpret_cast<const char *>(face.texels.data()), face.texels.size());
+        }
+        if (!file)
+        {
+            cerr << "Failed to write texture pack " << temporaryPath << "\n";
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        cerr << "Failed to move texture pack into place at " << path << "\n";
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+    cout << "Wrote " << path << ": " << BLOCK_TEXTURE_LAYERS << " block layers with " << BLOCK_TEXTURE_MIP_LEVELS << " mip levels, "
+         << skyboxSize << "x" << skyboxSize << " skybox, " << (header.fileSize >> 20) << " MB\n";
+    return true;
+}
+
+// a texture pack mapped into memory, its texels go to GL straight from the mapping
+class TexturePack
+{
+public:
+    TexturePack() = default;
+    TexturePack(const TexturePack &) = delete;
+    TexturePack &operator=(const TexturePack &) = delete;
+
+    ~TexturePack()
+    {
+        close();
+    }
+
+    // false when there is no pack, it is older than one of its source images or it does not match this build
+    bool open(const std::string &path)
+    {
+        std::error_code error;
+        auto packTime = std::filesystem::last_write_time(path, error);
+        if (error)
+        {
+            return false;
+        }
+        std::vector<std::string> sources = blockTexturePaths();
+        sources.insert(sources.end(), SKYBOX_FACES, SKYBOX_FACES + 6);
+        for (const auto &source : sources)
+        {
+            auto sourceTime = std::filesystem::last_write_time(source, error);
+            if (!error && sourceTime > packTime)
+            {
+                cout << "Texture pack " << path << " is older than " << source << ", rebuild it with pack_textures\n";
+                return false;
+            }
+        }
+        if (!map(path))
+        {
+            return false;
+        }
+        const TexturePackHeader *header = reinterpret_cast<const TexturePackHeader *>(data);
+        if (size < sizeof(TexturePackHeader) || header->magic != TEXTURE_PACK_MAGIC || header->version != TEXTURE_PACK_VERSION ||
+            header->blockSize != BLOCK_TEXTURE_SIZE || header->blockLayers != BLOCK_TEXTURE_LAYERS ||
+            header->blockMipLevels != BLOCK_TEXTURE_MIP_LEVELS || header->fileSize != size)
+        {
+            cout << "Texture pack " << path << " does not match this build, rebuild it with pack_textures\n";
+            close();
+            return false;
+        }
+        skyboxSize = (int)header->skyboxSize;
+        return true;
+    }
+
+    void close()
+    {
+        if (data == nullptr)
+        {
+            return;
+        }
+#ifdef _WIN32
+        UnmapViewOfFile(data);
+#else
+        munmap((void *)data, size);
+#endif
+        data = nullptr;
+        size = 0;
+    }
+
+    // all layers of one mip level of the block textures
+    const unsigned char *blockLevel(int level) const
+    {
+        const unsigned char *texels = data + sizeof(TexturePackHeader);
+        for (int i = 0; i < level; i++)
+        {
+            texels += blockLevelBytes(i);
+        }
+        return texels;
+    }
+
+    const unsigned char *skyboxFace(int face) const
+    {
+        return blockLevel(BLOCK_TEXTURE_MIP_LEVELS) + (size_t)face * skyboxSize * skyboxSize * 4;
+    }
+
+    int skyboxSize = 0;
+
+private:
+    const unsigned char *data = nullptr;
+    size_t size = 0;
+
+    bool map(const std::string &path)
+    {
+#ifdef _WIN32
+        HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+        if (file == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        GetFileSizeEx(file, &fileSize);
+        HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        CloseHandle(file);
+        if (mapping == nullptr)
+        {
+            return false;
+        }
+        data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        CloseHandle(mapping);
+        size = (size_t)fileSize.QuadPart;
+        return data != nullptr;
+#else
+        int file = ::open(path.c_str(), O_RDONLY);
+        if (file < 0)
+        {
+            return false;
+        }
+        struct stat status;
+        if (fstat(file, &status) != 0 || status.st_size <= 0)
+        {
+            ::close(file);
+            return false;
+        }
+        void *mapping = mmap(nullptr, (size_t)status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        ::close(file);
+        if (mapping == MAP_FAILED)
+        {
+            return false;
+        }
+        data = (const unsigned char *)mapping;
+        size = (size_t)status.st_size;
+        return true;
+#endif
+    }
+};
+
+#endif
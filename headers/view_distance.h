@@ -0,0 +1,102 @@
+#ifndef VIEW_DISTANCE_H
+#define VIEW_DISTANCE_H
+
+#include <algorithm>
+#include <cmath>
+#include <glm/glm.hpp>
+
+#include "chunk.h"
+#include "mesh.h"
+
+using namespace std;
+
+// view distances in chunks around the camera's chunk. chunks are unloaded one ring past the view distance, and below
+// the minimum those chunks would border fine chunks that read their blocks (see MESH_LOD_DISTANCES)
+const int VIEW_DISTANCE_MIN = 3;
+const int VIEW_DISTANCE_MAX = 12;
+const int VIEW_DISTANCE_START = 8;
+const int VIEW_DISTANCE_UNLOAD_MARGIN = 1;
+static_assert((2 * (VIEW_DISTANCE_MAX + VIEW_DISTANCE_UNLOAD_MARGIN) + 1) * (2 * (VIEW_DISTANCE_MAX + VIEW_DISTANCE_UNLOAD_MARGIN) + 1) <= (int)MAX_CHUNK_SLOTS,
+              "every loaded chunk needs a chunk slot");
+
+// every frame moves the smoothed frame time this far towards its own, so about the last 20 frames count
+const double VIEW_DISTANCE_SMOOTHING = 0.05;
+// shrink when the smoothed frame time is this far over the target, grow when it is this far under it
+const double VIEW_DISTANCE_SHRINK_RATIO = 1.1;
+const double VIEW_DISTANCE_GROW_RATIO = 0.7;
+// a change is only judged after this long, growing waits longer since the new ring is still being loaded
+const double VIEW_DISTANCE_SHRINK_DELAY_MS = 1000.0;
+const double VIEW_DISTANCE_GROW_DELAY_MS = 3000.0;
+
+// grows or shrinks the view distance to hold a target frame time. it only grows once the chunk pipeline has caught
+// up, so the cost of the chunks already asked for is known before more are added
+class ViewDistanceController
+{
+public:
+    // chunks loaded and drawn around the camera's chunk
+    int radius = VIEW_DISTANCE_START;
+    // keeps radius where it is
+    bool fixed = false;
+    double targetFrameMilliseconds = 1000.0 / 60.0;
+
+    void setTargetFps(double fps)
+    {
+        targetFrameMilliseconds = 1000.0 / std::max(1.0, fps);
+    }
+
+    void setFixedRadius(int chunks)
+    {
+        radius = std::clamp(chunks, VIEW_DISTANCE_MIN, VIEW_DISTANCE_MAX);
+        fixed = true;
+    }
+
+    // backlog counts the chunks in range that are not generated yet and the chunks waiting for a mesh. true when the
+    // radius changed
+    bool update(double frameMilliseconds, int backlog)
+    {
+        averageMilliseconds = averageMilliseconds == 0.0 ? frameMilliseconds : averageMilliseconds + VIEW_DISTANCE_SMOOTHING * (frameMilliseconds - averageMilliseconds);
+        sinceChangeMilliseconds += frameMilliseconds;
+        if (fixed)
+        {
+            return false;
+        }
+        if (averageMilliseconds > targetFrameMilliseconds * VIEW_DISTANCE_SHRINK_RATIO && radius > VIEW_DISTANCE_MIN &&
+            sinceChangeMilliseconds >= VIEW_DISTANCE_SHRINK_DELAY_MS)
+        {
+            radius--;
+            sinceChangeMilliseconds = 0.0;
+            return true;
+        }
+        if (averageMilliseconds < targetFrameMilliseconds * VIEW_DISTANCE_GROW_RATIO && radius < VIEW_DISTANCE_MAX && backlog == 0 &&
+            sinceChangeMilliseconds >= VIEW_DISTANCE_GROW_DELAY_MS)
+        {
+            radius++;
+            sinceChangeMilliseconds = 0.0;
+            return true;
+        }
+        return false;
+    }
+
+    // the far plane reaches the farthest corner of the drawn chunks around the camera's chunk, so the outermost ring
+    // is never cut off and frustrum culling drops everything past it
+    float farPlane(const glm::vec3 &cameraPosition) const
+    {
+        float size = (float)Chunk::CHUNK_SIZE;
+        // blocks are centered on their positions, so the chunks' faces start half a block before their origins
+        glm::vec2 inChunk = glm::vec2(cameraPosition.x, cameraPosition.z) - glm::floor(glm::vec2(cameraPosition.x, cameraPosition.z) / size) * size;
+        glm::vec2 across = radius * size + glm::max(size - 0.5f - inChunk, inChunk + 0.5f);
+        float up = std::max(std::abs(cameraPosition.y + 0.5f), std::abs(MESH_HEIGHT - 0.5f - cameraPosition.y));
+        return glm::length(glm::vec3(across.x, up, across.y));
+    }
+
+    double averageFrameMilliseconds() const
+    {
+        return averageMilliseconds;
+    }
+
+private:
+    double averageMilliseconds = 0.0;
+    double sinceChangeMilliseconds = 0.0;
+};
+
+#endif
@@ -0,0 +1,379 @@
+#ifndef WORLD_THREAD_H
+#define WORLD_THREAD_H
+
+#include <glm/glm.hpp>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+#include <cstdint>
+
+#include "camera.h"
+#include "chunk.h"
+#include "chunk_snapshot.h"
+#include "view_distance.h"
+
+using namespace std;
+
+// the camera moves in steps of a fixed length, this many a second
+const int WORLD_TICK_RATE = 60;
+const double WORLD_TICK_SECONDS = 1.0 / WORLD_TICK_RATE;
+// a pass of the world thread generates at most this many chunks, the nearest first, so ticks stay on time
+const int MAX_CHUNKS_GENERATED_PER_PASS = 4;
+// after a stall the camera catches up at most this many ticks instead of spiralling
+const int MAX_WORLD_TICKS_PER_PASS = 8;
+
+// movement keys held on the render thread, one bit per Camera_Movement
+inline uint8_t movementBit(Camera_Movement direction)
+{
+    return (uint8_t)(1 << direction);
+}
+
+struct CameraState
+{
+    glm::vec3 position = glm::vec3(0.0f);
+    float yaw = YAW;
+    float pitch = PITCH;
+    float zoom = ZOOM;
+};
+
+// the world after a tick, never changed once published so the render thread can draw it while the next one is built
+struct WorldSnapshot
+{
+    uint64_t tick = 0;
+    // when the tick happened, the render thread blends from previousCamera to camera over the tick after it
+    std::chrono::steady_clock::time_point tickTime;
+    CameraState previousCamera;
+    CameraState camera;
+    std::shared_ptr<const ChunkMap> chunks = std::make_shared<const ChunkMap>();
+    // chunks in range that are still to be generated
+    int missingChunks = 0;
+
+    // the camera blended between the last two ticks for a frame drawn at time
+    CameraState cameraAt(std::chrono::steady_clock::time_point time) const
+    {
+        double blend = std::chrono::duration<double>(time - tickTime).count() / WORLD_TICK_SECONDS;
+        float t = (float)std::min(1.0, std::max(0.0, blend));
+        CameraState state;
+        state.position = glm::mix(previousCamera.position, camera.position, t);
+        state.yaw = glm::mix(previousCamera.yaw, camera.yaw, t);
+        state.pitch = glm::mix(previousCamera.pitch, camera.pitch, t);
+        state.zoom = glm::mix(previousCamera.zoom, camera.zoom, t);
+        return state;
+    }
+};
+
+// chunks loaded and unloaded since the render thread last took a snapshot, and the time the world thread spent
+struct ChunkChanges
+{
+    std::vector<glm::vec3> loaded;
+    std::vector<glm::vec3> unloaded;
+    double worldMilliseconds = 0.0;
+
+    void clear()
+    {
+        loaded.clear();
+        unloaded.clear();
+        worldMilliseconds = 0.0;
+    }
+};
+
+// moves the camera at a fixed tick rate and streams chunks around it on its own thread. the render thread hands it
+// input and the view distance, and takes the latest snapshot every frame; neither ever waits for the other's work,
+// only for a few copies under a lock
+class WorldThread
+{
+public:
+    ~WorldThread()
+    {
+        stop();
+    }
+
+    void start(const glm::vec3 &cameraPosition)
+    {
+        camera = Camera(cameraPosition);
+        auto snapshot = std::make_shared<WorldSnapshot>();
+        snapshot->camera = cameraState();
+        snapshot->previousCamera = snapshot->camera;
+        snapshot->tickTime = std::chrono::steady_clock::now();
+        published = snapshot;
+        running = true;
+        thread = std::thread(&WorldThread::run, this);
+    }
+
+    void stop()
+    {
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            if (!running)
+            {
+                return;
+            }
+            running = false;
+        }
+        wake.notify_all();
+        thread.join();
+    }
+
+    // held movement keys, see movementBit
+    void setMovement(uint8_t movement)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input.movement = movement;
+    }
+
+    // mouse and scroll offsets add up until the next tick uses them
+    void addMouseMovement(float xoffset, float yoffset)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input.mouseX += xoffset;
+        input.mouseY += yoffset;
+    }
+
+    void addScroll(float yoffset)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input.scroll += yoffset;
+    }
+
+    // places the camera instead of moving it by input, for scripted camera paths
+    void setPose(const glm::vec3 &position, float yaw, float pitch)
+    {
+        std::lock_guard<std::mutex> lock(inputMutex);
+        input.hasPose = true;
+        input.position = position;
+        input.yaw = yaw;
+        input.pitch = pitch;
+    }
+
+    void setViewRadius(int radius)
+    {
+        bool changed;
+        {
+            std::lock_guard<std::mutex> lock(inputMutex);
+            changed = input.viewRadius != radius;
+            input.viewRadius = radius;
+        }
+        if (changed)
+        {
+            wake.notify_all();
+        }
+    }
+
+    // the newest snapshot, and every chunk change since the last call moved into changes
+    std::shared_ptr<const WorldSnapshot> takeSnapshot(ChunkChanges &changes)
+    {
+        changes.clear();
+        std::lock_guard<std::mutex> lock(snapshotMutex);
+        std::swap(changes, pendingChanges);
+        return published;
+    }
+
+private:
+    struct Input
+    {
+        uint8_t movement = 0;
+        float mouseX = 0.0f;
+        float mouseY = 0.0f;
+        float scroll = 0.0f;
+        bool hasPose = false;
+        glm::vec3 position = glm::vec3(0.0f);
+        float yaw = YAW;
+        float pitch = PITCH;
+        int viewRadius = VIEW_DISTANCE_START;
+    };
+
+    std::thread thread;
+    // running, input and wake belong to inputMutex
+    std::mutex inputMutex;
+    std::condition_variable wake;
+    bool running = false;
+    Input input;
+
+    std::mutex snapshotMutex;
+    std::shared_ptr<const WorldSnapshot> published;
+    ChunkChanges pendingChanges;
+
+    // only touched by the world thread
+    Camera camera;
+    ChunkMap chunks;
+    std::vector<glm::vec3> loaded, unloaded;
+
+    CameraState cameraState() const
+    {
+        CameraState state;
+        state.position = camera.Position;
+        state.yaw = camera.Yaw;
+        state.pitch = camera.Pitch;
+        state.zoom = camera.Zoom;
+        return state;
+    }
+
+    void run()
+    {
+        auto nextTick = std::chrono::steady_clock::now();
+        auto tickLength = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(WORLD_TICK_SECONDS));
+        uint64_t tick = 0;
+        CameraState previousCamera = cameraState();
+        std::chrono::steady_clock::time_point tickTime = nextTick;
+        int missing = 0;
+        while (true)
+        {
+            Input frameInput;
+            std::chrono::steady_clock::time_point passStart;
+            {
+                std::unique_lock<std::mutex> lock(inputMutex);
+                // sleep until the next tick unless chunks are still waiting to be generated
+                if (missing == 0)
+                {
+                    wake.wait_until(lock, nextTick, [&]
+                                    { return !running || std::chrono::steady_clock::now() >= nextTick; });
+                }
+                if (!running)
+                {
+                    return;
+                }
+                frameInput = input;
+                passStart = std::chrono::steady_clock::now();
+                if (passStart >= nextTick)
+                {
+                    // the mouse and scroll offsets are used up by this tick
+                    input.mouseX = 0.0f;
+                    input.mouseY = 0.0f;
+                    input.scroll = 0.0f;
+                    input.hasPose = false;
+                }
+            }
+
+            // fixed steps for however many ticks are due, the last two camera states go into the snapshot
+            int ticks = 0;
+            while (passStart >= nextTick && ticks < MAX_WORLD_TICKS_PER_PASS)
+            {
+                previousCamera = cameraState();
+                tickCamera(frameInput, ticks == 0);
+                tickTime = nextTick;
+                nextTick += tickLength;
+                tick++;
+                ticks++;
+            }
+            if (passStart >= nextTick)
+            {
+                // too far behind, drop the ticks instead of catching up on all of them
+                nextTick = passStart + tickLength;
+            }
+
+            loaded.clear();
+            unloaded.clear();
+            missing = streamChunks(frameInput.viewRadius);
+            if (ticks == 0 && loaded.empty() && unloaded.empty())
+            {
+                continue;
+            }
+
+            // a new map is only copied when chunks changed, the render thread may still be reading the old one
+            auto snapshot = std::make_shared<WorldSnapshot>();
+            snapshot->tick = tick;
+            snapshot->tickTime = tickTime;
+            snapshot->previousCamera = previousCamera;
+            snapshot->camera = cameraState();
+            snapshot->missingChunks = missing;
+            std::shared_ptr<const ChunkMap> publishedChunks;
+            {
+                std::lock_guard<std::mutex> lock(snapshotMutex);
+                publishedChunks = published->chunks;
+            }
+            snapshot->chunks = loaded.empty() && unloaded.empty() ? publishedChunks : std::make_shared<const ChunkMap>(chunks);
+            double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - passStart).count();
+
+            std::lock_guard<std::mutex> lock(snapshotMutex);
+            published = snapshot;
+            pendingChanges.loaded.insert(pendingChanges.loaded.end(), loaded.begin(), loaded.end());
+            pendingChanges.unloaded.insert(pendingChanges.unloaded.end(), unloaded.begin(), unloaded.end());
+            pendingChanges.worldMilliseconds += milliseconds;
+        }
+    }
+
+    // one fixed step of the camera. the mouse and scroll offsets of the whole pass only go into its first step
+    void tickCamera(const Input &frameInput, bool firstStep)
+    {
+        if (frameInput.hasPose)
+        {
+            camera.SetPose(frameInput.position, frameInput.yaw, frameInput.pitch);
+            return;
+        }
+        if (firstStep)
+        {
+            camera.ProcessMouseMovement(frameInput.mouseX, frameInput.mouseY);
+            camera.ProcessMouseScroll(frameInput.scroll);
+        }
+        for (int direction = FORWARD; direction <= RIGHT; direction++)
+        {
+            if ((frameInput.movement & movementBit((Camera_Movement)direction)) != 0)
+            {
+                camera.ProcessKeyboard((Camera_Movement)direction, (float)WORLD_TICK_SECONDS);
+            }
+        }
+    }
+
+    // unloads the chunks a ring past the view distance and generates the nearest missing ones. returns how many chunks
+    // in range are still missing
+    int streamChunks(int radius)
+    {
+        float x_chunk = (float)std::floor(camera.Position.x / Chunk::CHUNK_SIZE);
+        float z_chunk = (float)std::floor(camera.Position.z / Chunk::CHUNK_SIZE);
+
+        // the ring between the view distance and the unloaded chunks keeps chunks from being unloaded and loaded again
+        // while the camera or the view distance goes back and forth
+        int unloadRadius = radius + VIEW_DISTANCE_UNLOAD_MARGIN;
+        for (auto it = chunks.begin(); it != chunks.end();)
+        {
+            float distance = std::max(std::abs(it->first.x / Chunk::CHUNK_SIZE - x_chunk), std::abs(it->first.z / Chunk::CHUNK_SIZE - z_chunk));
+            if (distance > unloadRadius)
+            {
+                unloaded.push_back(it->first);
+                it = chunks.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+
+        // one ring of chunks at a time from the camera outwards
+        int missing = 0;
+        for (int ring = 0; ring <= radius; ring++)
+        {
+            for (int x_offset = -ring; x_offset <= ring; x_offset++)
+            {
+                for (int z_offset = -ring; z_offset <= ring; z_offset++)
+                {
+                    if (std::abs(x_offset) != ring && std::abs(z_offset) != ring)
+                    {
+                        continue;
+                    }
+                    glm::vec3 origin((x_chunk + x_offset) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + z_offset) * Chunk::CHUNK_SIZE);
+                    if (chunks.find(origin) != chunks.end())
+                    {
+                        continue;
+                    }
+                    if ((int)loaded.size() < MAX_CHUNKS_GENERATED_PER_PASS)
+                    {
+                        chunks[origin] = std::make_shared<const Chunk>(origin);
+                        loaded.push_back(origin);
+                    }
+                    else
+                    {
+                        missing++;
+                    }
+                }
+            }
+        }
+        return missing;
+    }
+};
+
+#endif
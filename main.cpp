@@ -23,14 +23,21 @@
 #include <thread>
 #include <atomic>
 #include <map>
+#include <cstddef>
+#include <chrono>
 #include "headers/shader.h"
-#include "headers/stb_image.h"
+#include "headers/texture_pack.h"
 #include "headers/camera.h"
 #include "headers/chunk.h"
 #include "headers/mesh.h"
+#include "headers/block_textures.h"
 #include "headers/block.h"
 #include "headers/frustrum.h"
 #include "headers/plane.h"
+#include "headers/frame_benchmark.h"
+#include "headers/frame_profiler.h"
+#include "headers/view_distance.h"
+#include "headers/world_thread.h"
 
 using namespace std;
 
@@ -39,38 +46,27 @@ void framebuffer_size_callback(GLFWwindow *window, int width, int height);
 void processInput(GLFWwindow *window);
 void mouse_callback(GLFWwindow *window, double xpos, double ypos);
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset);
-void generateBindTextures(unsigned int &texture, const char *path);
-unsigned int loadCubemap(vector<std::string> faces);
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods);
+unsigned int loadBlockTextureArray(const TexturePack &pack, const vector<DecodedImage> &images);
+unsigned int loadCubemap(const TexturePack &pack, const vector<DecodedImage> &images);
 void drawSkybox(unsigned int cubemapTextureID);
-void checkNewChunks(glm::vec3 playerPos, unordered_set<Chunk> &chunks, Mesh &mesh);
-Frustrum createFrustrumFromCamera(const Camera &camera, float aspect, float fovY, float zNear, float zFar);
-bool isCubeInFrustrum(const Frustrum &frustum, const glm::vec3 &cubeCenter, float radius);
+void printArenaStats(const InstanceArenaStats &stats);
 
 // window size
 const unsigned int SRC_WIDTH = 1200;
 const unsigned int SRC_HEIGHT = 800;
 
-// camera shit
+// camera shit, frames are drawn from it after it is placed where the world thread's snapshot has it
 Camera camera(glm::vec3(8.0f, 20.0f, 8.0f));
+// moves the camera and streams chunks on its own thread, input goes to it from the callbacks
+WorldThread world;
 
-// planes for frustrum
-Plane topFace;
-Plane bottomFace;
-Plane rightFace;
-Plane leftFace;
-Plane frontFace;
-Plane rearFace;
-
-// frustrum
+// frustrum, built from the view projection matrix every frame
 Frustrum frustrum;
 
 float lastX = 400, lastY = 300;
 bool firstMouse = true;
 
-// delta time
-float deltaTime = 0.0f;
-float lastFrame = 0.0f;
-
 // fps counters
 double lastFPSTime = 0.0;
 int frameCount = 0;
@@ -78,9 +74,48 @@ int frameCount = 0;
 // global mutex
 std::mutex worldDataMutex;
 
-int main()
+// per stage frame timings, F3 toggles it
+FrameProfiler profiler;
+// opaque chunks are drawn to the depth buffer first so the color pass only shades the nearest fragments, F4 toggles it
+bool depthPrepass = false;
+// fragments shaded per pixel by the world passes, F5 toggles it
+OverdrawCounter overdrawCounter;
+GpuFrameTimer gpuFrameTimer;
+// size of the framebuffer being rendered to, for the overdraw counter
+int viewportWidth = SRC_WIDTH, viewportHeight = SRC_HEIGHT;
+
+// time the render thread may spend per frame taking finished chunk meshes from the workers
+const double MESH_UPLOAD_BUDGET_MS = 2.0;
+// headless runs start timing anyway when the chunks around the path's start are still streaming after this long
+const double HEADLESS_WARMUP_MAX_SECONDS = 60.0;
+
+// chunks are loaded and drawn this many chunks around the camera's chunk, the distant ones with coarse meshes (see
+// MESH_LOD_DISTANCES). the radius follows the frame time, loading, culling and the far plane all use it
+ViewDistanceController viewDistance;
+
+int main(int argc, char **argv)
 {
+    RunOptions options;
+    if (!parseRunOptions(argc, argv, options))
+    {
+        return 1;
+    }
+    CameraPath cameraPath;
+    if (options.cameraPath.empty())
+    {
+        cameraPath.makeDefault();
+    }
+    else if (!cameraPath.load(options.cameraPath))
+    {
+        return 1;
+    }
+
     /*   Initializing OPENGL, Creating and defining a window  ************************************************************************************************************* */
+    // headless runs use GLFW's null platform, which needs no display, with a context from Mesa's OSMesa or EGL
+    if (options.headless)
+    {
+        glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    }
     // Initialize GLFW
     if (!glfwInit())
     {
@@ -92,6 +127,11 @@ int main()
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
     // forward compat is required for mac os
     glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    if (options.headless)
+    {
+        glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+        glfwWindowHint(GLFW_CONTEXT_CREATION_API, options.useEGL ? GLFW_EGL_CONTEXT_API : GLFW_OSMESA_CONTEXT_API);
+    }
 
     // Initialize window
     GLFWwindow *window = glfwCreateWindow(SRC_WIDTH, SRC_HEIGHT, "Fuck Me", NULL, NULL);
@@ -104,17 +144,23 @@ int main()
     // set window to current context
     glfwMakeContextCurrent(window);
 
-    // Register the framebuffer size callback
-    glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+    if (!options.headless)
+    {
+        // Register the framebuffer size callback
+        glfwSetFramebufferSizeCallback(window, framebuffer_size_callback);
+
+        // Hide cursor and capture it
+        glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
 
-    // Hide cursor and capture it
-    glfwSetInputMode(window, GLFW_CURSOR, GLFW_CURSOR_DISABLED);
+        // set cursor callback
+        glfwSetCursorPosCallback(window, mouse_callback);
 
-    // set cursor callback
-    glfwSetCursorPosCallback(window, mouse_callback);
+        // set scroll callback
+        glfwSetScrollCallback(window, scroll_callback);
 
-    // set scroll callback
-    glfwSetScrollCallback(window, scroll_callback);
+        // set key callback for toggles, movement is polled in processInput
+        glfwSetKeyCallback(window, key_callback);
+    }
 
     // initialize GLAD
     if (!gladLoadGLLoader((GLADloadproc)glfwGetProcAddress))
@@ -122,86 +168,66 @@ int main()
         cout << "Failed to initialize glad" << endl;
         return -1;
     }
-    // define shaders
+    loadGLExtensions((GLADloadproc)glfwGetProcAddress);
+
+    // define shaders, both are started before either is waited for so they can compile at the same time
+    auto shaderStart = std::chrono::steady_clock::now();
     Shader textureShader("shaders/texture.vs", "shaders/texture.fs");
 
     Shader skyboxShader("shaders/skybox.vs", "shaders/skybox.fs");
+    Shader depthShader("shaders/texture.vs", "shaders/depth.fs");
+    textureShader.finishLinking();
+    skyboxShader.finishLinking();
+    depthShader.finishLinking();
+    std::chrono::duration<double, std::milli> shaderTime = std::chrono::steady_clock::now() - shaderStart;
+    cout << "Shaders ready in " << shaderTime.count() << " ms ("
+         << textureShader.loadedFromCache + skyboxShader.loadedFromCache + depthShader.loadedFromCache << " of 3 from the program binary cache)\n";
+
+    // samplers never change units, so they are set once here. camera and light go through the FrameData block
+    textureShader.use();
+    textureShader.setInt("blockTextures", 0); // Tell world shader sampler "blockTextures" to use texture unit 0
+    textureShader.setInt("chunkOrigins", CHUNK_ORIGIN_TEXTURE_UNIT);
+    skyboxShader.use();
+    skyboxShader.setInt("skybox", 0); // Use texture unit 0
+    depthShader.use();
+    depthShader.setInt("chunkOrigins", CHUNK_ORIGIN_TEXTURE_UNIT);
+    depthShader.setInt("blockTextures", 0);
+    FrameUniforms frameUniforms;
+    frameUniforms.create();
+    profiler.create();
+    profiler.setEnabled(options.profile);
+    overdrawCounter.create();
+    overdrawCounter.setEnabled(options.overdraw);
+    gpuFrameTimer.create();
+    depthPrepass = options.depthPrepass;
+    viewDistance.setTargetFps(options.targetFps);
+    if (options.viewDistance > 0)
+    {
+        viewDistance.setFixedRadius(options.viewDistance);
+    }
+    else if (options.headless && !options.adaptiveViewDistance)
+    {
+        // an adjusted radius would follow the machine, so runs could not be compared
+        viewDistance.setFixedRadius(VIEW_DISTANCE_START);
+    }
 
     // tell openGL the size of the window
     int fbWidth, fbHeight;
     glfwGetFramebufferSize(window, &fbWidth, &fbHeight);
     glViewport(0, 0, fbWidth, fbHeight);
+    if (!options.headless)
+    {
+        viewportWidth = fbWidth;
+        viewportHeight = fbHeight;
+    }
 
-    topFace.normal = camera.Position + glm::vec3(0.0f, 4.0f, 0.0f);
-    topFace.distance = 4.0f;
-    bottomFace.normal = camera.Position + glm::vec3(0.0f, -4.0f, 0.0f);
-    bottomFace.distance = 4.0f;
-    rightFace.normal = camera.Position + glm::vec3(4.0f, 0.0f, 0.0f);
-    rightFace.distance = 4.0f;
-    leftFace.normal = camera.Position + glm::vec3(-4.0f, 0.0f, 0.0f);
-    leftFace.distance = 4.0f;
-    frontFace.normal = camera.Position + glm::vec3(0.0f, 0.0f, 4.0f);
-    frontFace.distance = 4.0f;
-    rearFace.normal = camera.Position + glm::vec3(0.0f, 0.0f, -4.0f);
-    rearFace.distance = 4.0f;
-
-    // define frustrum faces
-    frustrum.topFace = topFace;
-    frustrum.bottomFace = bottomFace;
-    frustrum.rightFace = rightFace;
-    frustrum.leftFace = leftFace;
-    frustrum.frontFace = frontFace;
-    frustrum.rearFace = rearFace;
-
-    // the vetices are laid out by the x,y,z positions, then the next 2 lay out how the texture is mapped to the vertices. the last 3 then represent the normal vector perpendicular to each plane the groups of vertices represent.
-    float vertices[] = {
-        // Face -Z (front)
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
-        -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 0.0f, 0.0f, -1.0f,
-        0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, -1.0f,
-        0.5f, 0.5f, -0.5f, 1.0f, 1.0f, 0.0f, 0.0f, -1.0f,
-        0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 0.0f, -1.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 0.0f, -1.0f,
-
-        // Face +Z (back)
-        -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
-        0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 0.0f, 0.0f, 1.0f,
-        0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-        0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-        -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f, 1.0f,
-        -0.5f, -0.5f, 0.5f, 0.0f, 0.0f, 0.0f, 0.0f, 1.0f,
-
-        // Face -X (left)
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f, 0.5f, 1.0f, 0.0f, -1.0f, 0.0f, 0.0f,
-        -0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f,
-        -0.5f, 0.5f, 0.5f, 1.0f, 1.0f, -1.0f, 0.0f, 0.0f,
-        -0.5f, 0.5f, -0.5f, 0.0f, 1.0f, -1.0f, 0.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f,
-
-        // Face +X (right)
-        0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-        0.5f, 0.5f, -0.5f, 0.0f, 1.0f, 1.0f, 0.0f, 0.0f,
-        0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f,
-        0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 1.0f, 0.0f, 0.0f,
-        0.5f, -0.5f, 0.5f, 1.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-        0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f,
-
-        // Face -Y (bottom)
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f,
-        0.5f, -0.5f, -0.5f, 1.0f, 0.0f, 0.0f, -1.0f, 0.0f,
-        0.5f, -0.5f, 0.5f, 1.0f, 1.0f, 0.0f, -1.0f, 0.0f,
-        0.5f, -0.5f, 0.5f, 1.0f, 1.0f, 0.0f, -1.0f, 0.0f,
-        -0.5f, -0.5f, 0.5f, 0.0f, 1.0f, 0.0f, -1.0f, 0.0f,
-        -0.5f, -0.5f, -0.5f, 0.0f, 0.0f, 0.0f, -1.0f, 0.0f,
-
-        // Face +Y (top)
-        -0.5f, 0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f,
-        -0.5f, 0.5f, 0.5f, 0.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-        0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-        0.5f, 0.5f, 0.5f, 1.0f, 1.0f, 0.0f, 1.0f, 0.0f,
-        0.5f, 0.5f, -0.5f, 1.0f, 0.0f, 0.0f, 1.0f, 0.0f,
-        -0.5f, 0.5f, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f};
+    // without a window to present to, frames go to an offscreen framebuffer of the window's size
+    OffscreenTarget offscreen;
+    if (options.headless && !offscreen.create(SRC_WIDTH, SRC_HEIGHT))
+    {
+        glfwTerminate();
+        return -1;
+    }
 
     // skybox verticles are just the x, y, z positions
     float skyboxVertices[] = {
@@ -256,53 +282,13 @@ int main()
     glEnable(GL_BLEND);
     glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-    // VBO
-    unsigned int VBO, VAO;
+    // the world VAO has no vertex buffer, texture.vs builds each quad's corners from gl_VertexID
+    unsigned int VAO;
     glGenVertexArrays(1, &VAO);
-    glGenBuffers(1, &VBO);
-    // bind vertex arrray object first
     glBindVertexArray(VAO);
-    // bind bufffer object to buffer target
-    glBindBuffer(GL_ARRAY_BUFFER, VBO);
-    glBufferData(GL_ARRAY_BUFFER, sizeof(vertices), vertices, GL_STATIC_DRAW);
 
-    GLsizei stride = (3 + 2 + 3) * sizeof(float);
-    // position attribute
-    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, stride, (void *)0);
-    glEnableVertexAttribArray(0);
-    // texture coord attribute
-    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, stride, (void *)(3 * sizeof(float)));
-    glEnableVertexAttribArray(1);
-    // normal vector attribute
-    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, stride, (void *)((3 + 2) * sizeof(float)));
-    glEnableVertexAttribArray(2);
-
-    // instance VBO
-    unsigned int instanceMatrixVBO;
-    glGenBuffers(1, &instanceMatrixVBO);
-    glBindBuffer(GL_ARRAY_BUFFER, instanceMatrixVBO);
-    const int MAX_INSTANCES_PER_BATCH = 1000000;
-    glBufferData(GL_ARRAY_BUFFER, MAX_INSTANCES_PER_BATCH * sizeof(glm::mat4), nullptr, GL_DYNAMIC_DRAW);
-
-    // Attribute location 3 (first vec4 of the mat4)
-    glEnableVertexAttribArray(3);
-    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)0);
-    glVertexAttribDivisor(3, 1); // Tell OpenGL this is an instanced vertex attribute (advances once per instance)
-
-    // Attribute location 4 (second vec4 of the mat4)
-    glEnableVertexAttribArray(4);
-    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(sizeof(glm::vec4)));
-    glVertexAttribDivisor(4, 1);
-
-    // Attribute location 5 (third vec4 of the mat4)
-    glEnableVertexAttribArray(5);
-    glVertexAttribPointer(5, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(2 * sizeof(glm::vec4)));
-    glVertexAttribDivisor(5, 1);
-
-    // Attribute location 6 (fourth vec4 of the mat4)
-    glEnableVertexAttribArray(6);
-    glVertexAttribPointer(6, 4, GL_FLOAT, GL_FALSE, sizeof(glm::mat4), (void *)(3 * sizeof(glm::vec4)));
-    glVertexAttribDivisor(6, 1);
+    // per instance attributes, Mesh::drawChunks points them at the instance arena slab of every draw run
+    enableInstanceAttributes();
 
     // skybox VBO
     unsigned int skyboxVBO, skyboxVAO;
@@ -338,64 +324,23 @@ int main()
     // WIREFRAME DRAWING
     // glPolygonMode(GL_FRONT_AND_BACK, GL_LINE);
 
-    // generate and bind texture id
-    unsigned int texture1 = 0, texture2 = 0, texture3 = 0;
-    unsigned int grass_textures[3] = {texture1, texture2, texture3};
-    for (int i = 0; i < 3; i++)
-    {
-        string path = "graphics/grass_block/" + to_string(i) + ".png";
-        generateBindTextures(grass_textures[i], path.c_str());
-    }
-    unsigned int texture4 = 0;
-    unsigned int dirt_textures[3] = {texture4};
-    for (int i = 0; i < 3; i++)
-    {
-        string path = "graphics/dirt_block/" + to_string(i) + ".png";
-        generateBindTextures(dirt_textures[i], path.c_str());
-    }
-
-    unsigned int texture5 = 0;
-    unsigned int sand_textures[3] = {texture5};
-    for (int i = 0; i < 3; i++)
-    {
-        string path = "graphics/sand_block/" + to_string(i) + ".png";
-        generateBindTextures(sand_textures[i], path.c_str());
-    }
-
-    unsigned int texture6 = 0;
-    unsigned int tree_textures[3] = {texture6};
-    for (int i = 0; i < 3; i++)
-    {
-        string path = "graphics/tree_block/" + to_string(i) + ".png";
-        generateBindTextures(tree_textures[i], path.c_str());
-    }
-
-    unsigned int texture7 = 0;
-    unsigned int leaf_textures[3] = {texture7};
-    for (int i = 0; i < 3; i++)
-    {
-        string path = "graphics/leaf_block/" + to_string(i) + ".png";
-        generateBindTextures(leaf_textures[i], path.c_str());
-    }
-
-    unsigned int texture8 = 0;
-    unsigned int water_textures[3] = {texture8};
-    for (int i = 0; i < 3; i++)
+    // textures come straight out of the mapped pack when it is up to date, otherwise every PNG is decoded at once
+    // on worker threads before any of them is uploaded
+    TexturePack texturePack;
+    vector<DecodedImage> blockImages, skyboxImages;
+    auto textureStart = chrono::steady_clock::now();
+    bool packed = texturePack.open(TEXTURE_PACK_PATH);
+    if (!packed)
     {
-        string path = "graphics/water_block/" + to_string(i) + ".png";
-        generateBindTextures(water_textures[i], path.c_str());
+        decodeTextureSources(blockImages, skyboxImages);
     }
 
-    vector<std::string> skyboxFaces{
-        "graphics/skybox_1/0.png",
-        "graphics/skybox_1/1.png",
-        "graphics/skybox_1/2.png",
-        "graphics/skybox_1/3.png",
-        "graphics/skybox_1/4.png",
-        "graphics/skybox_1/5.png",
-    };
-
-    unsigned int cubemapTexture = loadCubemap(skyboxFaces);
+    // all block faces live in the layers of one texture array
+    unsigned int blockTextures = loadBlockTextureArray(texturePack, blockImages);
+    unsigned int cubemapTexture = loadCubemap(texturePack, skyboxImages);
+    texturePack.close();
+    cout << "Textures loaded from " << (packed ? TEXTURE_PACK_PATH : "PNG files") << " in "
+         << chrono::duration<double, milli>(chrono::steady_clock::now() - textureStart).count() << " ms\n";
 
     // check that we were able to create cubemap texture
     if (cubemapTexture == 0)
@@ -405,21 +350,27 @@ int main()
         return -1;
     }
 
-    // define list of chunks
-    std::unordered_set<Chunk> chunks;
-
-    // define light position
-    glm::vec3 lightPosition = glm::vec3(12.0f, 60.0f, -12.0f);
-
-    // define mesh
-    Mesh mesh(chunks);
-
-    while (!glfwWindowShouldClose(window))
+    // define mesh, chunks reach it from the world thread's snapshots
+    Mesh mesh{ChunkMap()};
+    ChunkChanges chunkChanges;
+    world.setViewRadius(viewDistance.radius);
+    world.start(camera.Position);
+
+    // headless runs warm up at the start of the camera path for at least warmupFrames, until every chunk in range is
+    // generated, meshed and uploaded, then time every frame along it. streaming runs on other threads, so a fixed
+    // number of frames would leave a different amount of it inside the timed frames on every machine
+    FrameStats frameStats;
+    int headlessFrame = 0;
+    int timedFrames = 0;
+    bool warmingUp = true;
+    auto warmupStart = std::chrono::steady_clock::now();
+    const glm::vec3 pathStart = cameraPath.sample(0.0f).position;
+
+    while (options.headless ? timedFrames < options.frames : !glfwWindowShouldClose(window))
     {
-        // calculate deltaTime
-        float currentFrame = glfwGetTime();
-        deltaTime = currentFrame - lastFrame;
-        lastFrame = currentFrame;
+        auto frameStart = std::chrono::steady_clock::now();
+        profiler.beginFrame();
+        gpuFrameTimer.begin();
 
         // --- FPS Counter Logic ---
         frameCount++;
@@ -431,47 +382,103 @@ int main()
             double fps = (double)frameCount / elapsedFPSTime;
             char windowTitle[256];
             // Using your original window title "Fuck Me" and adding FPS
-            sprintf(windowTitle, "Fuck Me - FPS: %.2f (%.3f ms/frame)", fps, 1000.0 / fps);
+            sprintf(windowTitle, "Fuck Me - FPS: %.2f (%.3f ms/frame) - view distance %d - chunks tested %d (%d regions), culled %d, unreachable %d, occluded %d, drawn %d", fps, 1000.0 / fps,
+                    viewDistance.radius, mesh.cullStats.tested, mesh.cullStats.nodesTested, mesh.cullStats.culled, mesh.cullStats.unreachable, mesh.cullStats.occluded, mesh.cullStats.drawn);
             glfwSetWindowTitle(window, windowTitle);
+            if (profiler.enabled)
+            {
+                profiler.print(frameCount);
+                printArenaStats(mesh.arenaStats());
+            }
+            if (overdrawCounter.enabled)
+            {
+                cout << "Overdraw: " << overdrawCounter.takeAverage() << " fragments per pixel" << (depthPrepass ? " with the depth pre-pass\n" : "\n");
+            }
 
             frameCount = 0;                  // Reset frame count for the next second
             lastFPSTime = currentSystemTime; // Reset time for the next second
         }
 
-        // process input
-        processInput(window);
+        // process input, or follow the camera path
+        profiler.beginStage(PROFILE_INPUT, false);
+        if (options.headless)
+        {
+            float pathTime = warmingUp ? 0.0f : (float)timedFrames / std::max(1, options.frames - 1);
+            CameraKey pose = cameraPath.sample(pathTime);
+            camera.SetPose(pose.position, pose.yaw, pose.pitch);
+            world.setPose(pose.position, pose.yaw, pose.pitch);
+        }
+        else
+        {
+            processInput(window);
+        }
+        profiler.endStage(PROFILE_INPUT);
         glClearColor(0.6f, 0.6f, 0.9f, 1.0f);
         glEnable(GL_DEPTH_TEST); // Ensure depth testing is enabled before clearing
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        frustrum = createFrustrumFromCamera(camera, (float)SRC_WIDTH / (float)SRC_HEIGHT, camera.Zoom, 0.1f, 40.0f);
-
-        // Check for new chunks to load/mesh - runs synchronously
-        checkNewChunks(camera.Position, chunks, mesh);
+        // take the world thread's newest snapshot and hand the chunks it loaded or unloaded to the mesh. it never
+        // waits for the world thread, a slow tick only means the same snapshot is drawn again
+        std::shared_ptr<const WorldSnapshot> snapshot;
+        {
+            ProfileScope scope(profiler, PROFILE_CHUNK_LOADING);
+            snapshot = world.takeSnapshot(chunkChanges);
+            if (!chunkChanges.unloaded.empty())
+            {
+                mesh.removeChunksFromMesh(chunkChanges.unloaded);
+            }
+            if (!chunkChanges.loaded.empty())
+            {
+                mesh.addChunksToMesh(*snapshot->chunks, chunkChanges.loaded);
+            }
+        }
+        profiler.addTime(PROFILE_WORLD, chunkChanges.worldMilliseconds);
+        const ChunkMap &chunks = *snapshot->chunks;
+        if (!options.headless)
+        {
+            CameraState cameraState = snapshot->cameraAt(frameStart);
+            camera.SetPose(cameraState.position, cameraState.yaw, cameraState.pitch);
+            camera.Zoom = cameraState.zoom;
+        }
 
-        // update mesh
-        mesh.updateMesh(chunks, frustrum);
- 
+        // take finished chunk meshes from the mesh workers, after requesting new levels of detail if the camera
+        // moved to another chunk
+        {
+            ProfileScope scope(profiler, PROFILE_UPLOADS, true);
+            mesh.updateLevelsOfDetail(chunks, camera.Position);
+            mesh.uploadPendingMeshes(MESH_UPLOAD_BUDGET_MS);
+            mesh.compactArena();
+        }
+        profiler.addTime(PROFILE_MESHING, mesh.workTimes.meshingMilliseconds);
+        profiler.addTime(PROFILE_INSTANCES, mesh.workTimes.instanceMilliseconds);
 
         // Common matrices
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SRC_WIDTH / (float)SRC_HEIGHT, 0.1f, 40.0f);
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SRC_WIDTH / (float)SRC_HEIGHT, 0.1f, viewDistance.farPlane(camera.Position));
         glm::mat4 view = camera.GetViewMatrix();
+        // read by every program for the rest of the frame
+        frameUniforms.update(mesh.uploadStream(), view, projection, camera.Position, LIGHT_POSITION, AMBIENT_STRENGTH);
+
+        // only chunks inside the view frustrum are submitted, the occlusion culler then works on them while the skybox
+        // is drawn
+        frustrum = Frustrum::fromViewProjection(projection * view);
+        profiler.beginStage(PROFILE_CULLING, false);
+        mesh.updateCameraConnectivity(chunks, camera.Position);
+        mesh.cullChunks(frustrum, projection * view, camera.Position);
+        profiler.endStage(PROFILE_CULLING);
 
         // --- Render Skybox ---
         glDepthFunc(GL_LEQUAL); // Change depth function so fragments equal to depth buffer value pass (skybox sits at far plane)
         glDepthMask(GL_FALSE);  // Disable writing to the depth buffer for the skybox
 
+        profiler.beginStage(PROFILE_SKYBOX, true);
         skyboxShader.use();
-        glm::mat4 skyboxView = glm::mat4(glm::mat3(view)); // Remove translation from the view matrix
-        skyboxShader.setMat4("view", skyboxView);
-        skyboxShader.setMat4("projection", projection);
-        skyboxShader.setInt("skybox", 0); // Use texture unit 0
 
         glBindVertexArray(skyboxVAO);
         glActiveTexture(GL_TEXTURE0);                       // Activate texture unit 0
         glBindTexture(GL_TEXTURE_CUBE_MAP, cubemapTexture); // Bind the cubemap texture
         glDrawArrays(GL_TRIANGLES, 0, 36);                  // Draw the skybox
         glBindVertexArray(0);                               // Unbind skybox VAO
+        profiler.endStage(PROFILE_SKYBOX);
 
         // --- Restore default state for world rendering ---
         glDepthMask(GL_TRUE);   // Re-enable depth writing **
@@ -481,153 +488,121 @@ int main()
 
         // --- Render World Geometry ---
         textureShader.use();
-        textureShader.setMat4("view", view); // Use the normal view matrix
-        textureShader.setMat4("projection", projection);
-        textureShader.setInt("texture1", 0); // Tell world shader sampler "texture1" to use texture unit 0
-        textureShader.setVec3("lightPos", lightPosition);
-        textureShader.setVec3("lightColor", 1.0f, 1.0f, 1.0f);
 
         glBindVertexArray(VAO); // Bind world geometry VAO
         glActiveTexture(GL_TEXTURE0);
-
-        // prepare opaque cubes for rendering
-        std::map<int, std::vector<glm::mat4>> opaqueInstanceMatrices;
-
-        // populate opaque instance data
-        for (const auto &renderCube : mesh.renderOpaqueCubes)
-        {
-
-            glm::mat4 model = glm::mat4(1.0f);
-            model = translate(model, renderCube.blockPosition);
-            opaqueInstanceMatrices[renderCube.blockType].push_back(model);
-        }
-
-        // render opaque cubes
-        for (const auto &pair : opaqueInstanceMatrices)
+        glBindTexture(GL_TEXTURE_2D_ARRAY, blockTextures);
+
+        // render opaque faces straight from the chunk buffers, nothing is rebuilt or uploaded here. waiting for the
+        // occlusion culler counts as culling
+        profiler.beginStage(PROFILE_CULLING, false);
+        mesh.finishCulling();
+        profiler.endStage(PROFILE_CULLING);
+        profiler.beginStage(PROFILE_WORLD_OPAQUE, true);
+        if (depthPrepass)
         {
-            int blockType = pair.first;
-            const std::vector<glm::mat4> &matrices = pair.second;
-
-            if (matrices.empty())
-                continue;
-            // Bind and upload instance data ONCE per block type
-            glBindBuffer(GL_ARRAY_BUFFER, instanceMatrixVBO);
-            size_t instancesToDraw = matrices.size();
-            if (instancesToDraw > MAX_INSTANCES_PER_BATCH)
-            {
-                std::cerr << "Warning: Instance Overload for opaque block type " << blockType
-                          << ". Clamping to " << MAX_INSTANCES_PER_BATCH << std::endl;
-                instancesToDraw = MAX_INSTANCES_PER_BATCH;
-            }
-            if (instancesToDraw == 0)
-                continue; // Nothing to draw for this batch
-
-            glBufferSubData(GL_ARRAY_BUFFER, 0, instancesToDraw * sizeof(glm::mat4), matrices.data());
-
-            // Now, draw based on block type and its texture configuration
-            if (blockType == GRASS)
-            {
-                // Side faces (vertices 0-23, 4 faces * 6 vertices)
-                glBindTexture(GL_TEXTURE_2D, grass_textures[0]); // 0
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 24, instancesToDraw);
-                // Bottom face (vertices 24-29, 1 face * 6 vertices)
-                glBindTexture(GL_TEXTURE_2D, grass_textures[2]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 30, instancesToDraw);
-                // Top face (vertices 30-35, 1 face * 6 vertices)
-                glBindTexture(GL_TEXTURE_2D, grass_textures[1]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instancesToDraw);
-            }
-            else if (blockType == DIRT)
-            {
-                glBindTexture(GL_TEXTURE_2D, dirt_textures[0]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instancesToDraw);
-            }
-            else if (blockType == TREE)
-            {
-                glBindTexture(GL_TEXTURE_2D, tree_textures[0]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instancesToDraw);
-            }
-            else if (blockType == WATER)
-            { // Assuming water is opaque here and uses one texture
-                glBindTexture(GL_TEXTURE_2D, water_textures[0]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instancesToDraw);
-            }
-            else if (blockType == SAND)
-            {
-                glBindTexture(GL_TEXTURE_2D, sand_textures[0]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instancesToDraw);
-            }
-            // Add other opaque block types here.
-            else
-            {
-                std::cerr << "Warning: Unhandled opaque block type or missing texture setup for type: " << blockType << std::endl;
-            }
+            // depth only, then the color pass keeps the depth buffer and shades the fragments that match it. both
+            // passes discard the same cut out texels. with depth writes off early depth testing still works with the
+            // discard in texture.fs
+            depthShader.use();
+            glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+            mesh.drawChunks(MESH_PASS_OPAQUE);
+            glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+            glDepthMask(GL_FALSE);
+            glDepthFunc(GL_LEQUAL);
+            textureShader.use();
         }
+        overdrawCounter.begin();
+        mesh.drawChunks(MESH_PASS_OPAQUE);
+        glDepthMask(GL_TRUE);
+        glDepthFunc(GL_LESS);
+        profiler.endStage(PROFILE_WORLD_OPAQUE);
 
         // Render transparent cubes afterwards
         glEnable(GL_BLEND);
         glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
-        std::map<int, std::vector<glm::mat4>> transparentInstanceMatrices;
-
-        glActiveTexture(GL_TEXTURE0);
-
-        // populate transparent instance data
-        for (const auto &renderCube : mesh.renderTransparentCubes)
-        {
+        profiler.beginStage(PROFILE_WORLD_TRANSPARENT, true);
+        mesh.drawChunks(MESH_PASS_TRANSPARENT);
+        overdrawCounter.end(viewportWidth, viewportHeight);
+        profiler.endStage(PROFILE_WORLD_TRANSPARENT);
+        mesh.finishFrame();
 
-            glm::mat4 model = glm::mat4(1.0f);
-            model = translate(model, renderCube.blockPosition);
-            transparentInstanceMatrices[renderCube.blockType].push_back(model);
-        }
+        glBindVertexArray(0); // Unbind world VAO
+        gpuFrameTimer.end();
 
-        // render transparent cubes
-        for (const auto &pair : transparentInstanceMatrices)
+        if (options.headless)
         {
-            int blockType = pair.first;
-            const std::vector<glm::mat4> &matrices = pair.second;
-
-            if (matrices.empty())
-                continue;
-            // Bind and upload instance data ONCE per block type
-            glBindBuffer(GL_ARRAY_BUFFER, instanceMatrixVBO);
-            size_t instancesToDraw = matrices.size();
-            if (instancesToDraw > MAX_INSTANCES_PER_BATCH)
-            {
-                std::cerr << "Warning: Instance Overload for opaque block type " << blockType
-                          << ". Clamping to " << MAX_INSTANCES_PER_BATCH << std::endl;
-                instancesToDraw = MAX_INSTANCES_PER_BATCH;
-            }
-            if (instancesToDraw == 0)
-                continue;
-
-            glBufferSubData(GL_ARRAY_BUFFER, 0, instancesToDraw * sizeof(glm::mat4), matrices.data());
-
-            if (blockType == LEAF)
+            // nothing is presented, so wait for the GPU to make the frame time include its work
+            glFinish();
+            std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStart;
+            int backlog = snapshot->missingChunks + (int)mesh.pendingMeshes();
+            viewDistance.update(frameTime.count(), backlog);
+            world.setViewRadius(viewDistance.radius);
+            headlessFrame++;
+            if (!warmingUp)
             {
-                glBindTexture(GL_TEXTURE_2D, leaf_textures[0]);
-                glDrawArraysInstanced(GL_TRIANGLES, 0, 36, instancesToDraw);
+                frameStats.add(frameTime.count());
+                timedFrames++;
             }
-            // Add other transparent block types here
-            else
+            else if (headlessFrame >= options.warmupFrames)
             {
-                std::cerr << "Warning: Unhandled opaque block type or missing texture setup for type: " << blockType << std::endl;
+                // the backlog only counts once the world thread has streamed around the path's start
+                double warmupSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - warmupStart).count();
+                if (snapshot->tick > 0 && snapshot->camera.position == pathStart && backlog == 0)
+                {
+                    warmingUp = false;
+                    cout << "Warmed up in " << headlessFrame << " frames\n";
+                }
+                else if (warmupSeconds >= HEADLESS_WARMUP_MAX_SECONDS)
+                {
+                    warmingUp = false;
+                    cerr << "Still streaming " << backlog << " chunks after " << headlessFrame << " warm up frames, timing anyway\n";
+                }
             }
+            profiler.endFrame();
+            glfwPollEvents();
+            continue;
         }
 
-        glBindVertexArray(0); // Unbind world VAO
+        // the swap waits for the display when vsync is on, so the view distance goes by the frame's time without it.
+        // the GPU's work also finishes inside the swap, so its time comes from the timer queries instead
+        std::chrono::duration<double, std::milli> frameTime = std::chrono::steady_clock::now() - frameStart;
+        viewDistance.update(std::max(frameTime.count(), gpuFrameTimer.milliseconds), snapshot->missingChunks + (int)mesh.pendingMeshes());
+        world.setViewRadius(viewDistance.radius);
 
         // check and call events and swap the buffers
         glfwSwapBuffers(window);
+        profiler.endFrame();
         glfwPollEvents();
     }
 
+    world.stop();
+    if (options.headless)
+    {
+        frameStats.write(options.statsPath, (const char *)glGetString(GL_RENDERER));
+        cout << "View distance at the end: " << viewDistance.radius << " chunks" << (viewDistance.fixed ? " (fixed)\n" : "\n");
+        if (profiler.enabled)
+        {
+            profiler.print(PROFILER_HISTORY);
+            printArenaStats(mesh.arenaStats());
+        }
+        if (overdrawCounter.enabled)
+        {
+            cout << "Overdraw: " << overdrawCounter.takeAverage() << " fragments per pixel\n";
+        }
+        offscreen.release();
+    }
+
     // de-allocate all resources once they've outlived their purpose:
     glDeleteVertexArrays(1, &VAO);
     glDeleteVertexArrays(1, &skyboxVAO);
-    glDeleteBuffers(1, &VBO);
     glDeleteBuffers(1, &skyboxVBO);
-    glDeleteBuffers(1, &instanceMatrixVBO);
+    glDeleteTextures(1, &blockTextures);
+    profiler.release();
+    overdrawCounter.release();
+    gpuFrameTimer.release();
+    mesh.releaseBuffers();
 
     // terminate glfw de-allocating all used resources
     glfwTerminate();
@@ -640,27 +615,32 @@ void processInput(GLFWwindow *window)
     {
         glfwSetWindowShouldClose(window, true);
     }
+    // the world thread moves the camera by the keys held at its next tick
+    uint8_t movement = 0;
     if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_UP) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(FORWARD, deltaTime);
+        movement |= movementBit(FORWARD);
     }
     if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_DOWN) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(BACKWARD, deltaTime);
+        movement |= movementBit(BACKWARD);
     }
     if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_LEFT) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(LEFT, deltaTime);
+        movement |= movementBit(LEFT);
     }
     if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS || glfwGetKey(window, GLFW_KEY_RIGHT) == GLFW_PRESS)
     {
-        camera.ProcessKeyboard(RIGHT, deltaTime);
+        movement |= movementBit(RIGHT);
     }
+    world.setMovement(movement);
 }
 
 void framebuffer_size_callback(GLFWwindow *window, int width, int height)
 {
     glViewport(0, 0, width, height);
+    viewportWidth = width;
+    viewportHeight = height;
 }
 
 void mouse_callback(GLFWwindow *window, double xpos, double ypos)
@@ -680,81 +660,108 @@ void mouse_callback(GLFWwindow *window, double xpos, double ypos)
     xoffset *= sensitivity;
     yoffset *= sensitivity;
 
-    camera.ProcessMouseMovement(xoffset, yoffset);
+    world.addMouseMovement(xoffset, yoffset);
 }
 
 void scroll_callback(GLFWwindow *window, double xoffset, double yoffset)
 {
-    camera.ProcessMouseScroll(static_cast<float>(yoffset));
+    world.addScroll(static_cast<float>(yoffset));
+}
+
+void key_callback(GLFWwindow *window, int key, int scancode, int action, int mods)
+{
+    // F3 switches the frame profiler, which prints its breakdown once a second while on
+    if (key == GLFW_KEY_F3 && action == GLFW_PRESS)
+    {
+        profiler.setEnabled(!profiler.enabled);
+        cout << "Frame profiler " << (profiler.enabled ? "on" : "off") << "\n";
+    }
+    // F4 switches the depth pre-pass of the opaque chunks
+    if (key == GLFW_KEY_F4 && action == GLFW_PRESS)
+    {
+        depthPrepass = !depthPrepass;
+        cout << "Depth pre-pass " << (depthPrepass ? "on" : "off") << "\n";
+    }
+    // F5 switches the overdraw counter, which prints the fragments shaded per pixel once a second while on
+    if (key == GLFW_KEY_F5 && action == GLFW_PRESS)
+    {
+        overdrawCounter.setEnabled(!overdrawCounter.enabled);
+        cout << "Overdraw counter " << (overdrawCounter.enabled ? "on" : "off") << "\n";
+    }
 }
 
-void generateBindTextures(unsigned int &texture, const char *path)
+unsigned int loadBlockTextureArray(const TexturePack &pack, const vector<DecodedImage> &images)
 {
+    unsigned int texture;
     glGenTextures(1, &texture);
-    glBindTexture(GL_TEXTURE_2D, texture);
-    // set the texture wrapping parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT); // set texture wrapping to GL_REPEAT (default wrapping method)
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, texture);
+    // set the texture wrapping parameters, merged faces repeat the texture once per block
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_REPEAT);
     // set texture filtering parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    // load and generate textures
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(1);
-    unsigned char *data = stbi_load(path, &width, &height, &nrChannels, 0);
-    if (data)
-    { // handle color GL color format
-        GLenum format = 0;
-        if (nrChannels == 1)
-            format = GL_RED;
-        else if (nrChannels == 3)
-            format = GL_RGB;
-        else if (nrChannels == 4)
-            format = GL_RGBA;
-        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-        glGenerateMipmap(GL_TEXTURE_2D);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, BLOCK_TEXTURE_MIP_LEVELS - 1);
+    for (int level = 0; level < BLOCK_TEXTURE_MIP_LEVELS; level++)
+    {
+        int size = BLOCK_TEXTURE_SIZE >> level;
+        glTexImage3D(GL_TEXTURE_2D_ARRAY, level, GL_RGBA8, size, size, BLOCK_TEXTURE_LAYERS, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+
+    // the pack already holds every layer of every mip level back to back
+    if (images.empty())
+    {
+        for (int level = 0; level < BLOCK_TEXTURE_MIP_LEVELS; level++)
+        {
+            int size = BLOCK_TEXTURE_SIZE >> level;
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, level, 0, 0, 0, size, size, BLOCK_TEXTURE_LAYERS, GL_RGBA, GL_UNSIGNED_BYTE, pack.blockLevel(level));
+        }
+        return texture;
     }
-    else
+
+    // decoded PNGs, always RGBA so they share one format, in layer order
+    vector<string> paths = blockTexturePaths();
+    for (int layer = 0; layer < BLOCK_TEXTURE_LAYERS; layer++)
     {
-        cerr << "Failed to load texture\n";
+        const DecodedImage &image = images[layer];
+        if (image.width == BLOCK_TEXTURE_SIZE && image.height == BLOCK_TEXTURE_SIZE)
+        {
+            glTexSubImage3D(GL_TEXTURE_2D_ARRAY, 0, 0, 0, layer, image.width, image.height, 1, GL_RGBA, GL_UNSIGNED_BYTE, image.texels.data());
+        }
+        else
+        {
+            cerr << "Failed to load texture " << paths[layer] << "\n";
+        }
     }
-    stbi_image_free(data);
+    glGenerateMipmap(GL_TEXTURE_2D_ARRAY);
+    return texture;
 }
 
-unsigned int loadCubemap(vector<std::string> faces)
+unsigned int loadCubemap(const TexturePack &pack, const vector<DecodedImage> &images)
 {
     unsigned int textureID;
     glGenTextures(1, &textureID);
     glBindTexture(GL_TEXTURE_CUBE_MAP, textureID);
 
-    int width, height, nrChannels;
-    stbi_set_flip_vertically_on_load(false); // Cubemaps often don't need flipping
-    for (unsigned int i = 0; i < faces.size(); i++)
+    // faces are RGBA whether they come from the pack or were decoded, neither is flipped
+    for (unsigned int i = 0; i < 6; i++)
     {
-        unsigned char *data = stbi_load(faces[i].c_str(), &width, &height, &nrChannels, 0);
-        if (data)
+        if (images.empty())
         {
-            GLenum format = GL_RGB; // Assuming RGB, adjust if your images have alpha
-            if (nrChannels == 1)
-                format = GL_RED;
-            else if (nrChannels == 3)
-                format = GL_RGB;
-            else if (nrChannels == 4)
-                format = GL_RGBA;
-
             glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, // Target face (+X, -X, +Y, ...)
-                         0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
-            stbi_image_free(data);
+                         0, GL_RGBA, pack.skyboxSize, pack.skyboxSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, pack.skyboxFace(i));
+        }
+        else if (images[i].width > 0)
+        {
+            glTexImage2D(GL_TEXTURE_CUBE_MAP_POSITIVE_X + i, 0, GL_RGBA, images[i].width, images[i].height, 0, GL_RGBA, GL_UNSIGNED_BYTE, images[i].texels.data());
         }
         else
         {
-            std::cerr << "Cubemap texture failed to load at path: " << faces[i] << std::endl;
-            stbi_image_free(data);           // Even if data is null, free attempts are safe
+            std::cerr << "Cubemap texture failed to load at path: " << SKYBOX_FACES[i] << std::endl;
             glDeleteTextures(1, &textureID); // Clean up texture ID if loading fails
             return 0;                        // Return 0 to indicate failure
         }
     }
-    stbi_set_flip_vertically_on_load(true); // Set back to true for other textures if needed
 
     // Set cubemap texture parameters
     glTexParameteri(GL_TEXTURE_CUBE_MAP, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -777,135 +784,8 @@ void drawSkybox(unsigned int cubemapTextureID)
     glDrawArrays(GL_TRIANGLES, 0, 36);
 }
 
-void checkNewChunks(glm::vec3 playerPos, unordered_set<Chunk> &chunks, Mesh &mesh)
-{
-    // current x and y chunk
-    float x_chunk = (float)floor(playerPos.x / 16);
-    float z_chunk = (float)floor(playerPos.z / 16);
-    unordered_set<Chunk> newChunks;
-    // use for when loop is created to check a larger radius
-    int renderRange = 10;
-
-    // check if surrounding chunks exist
-    int chunk_amount = newChunks.size();
-    if (chunks.find(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk)*Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk)*Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk)*Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, z_chunk * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, z_chunk * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, z_chunk * Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk)*Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk)*Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk)*Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk)*Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk + 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk - 1) * Chunk::CHUNK_SIZE)));
-    }
-    if (chunks.find(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE))) == chunks.end())
-    {
-        chunks.insert(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE)));
-        newChunks.insert(Chunk(glm::vec3((x_chunk - 1) * Chunk::CHUNK_SIZE, 0.0f, (z_chunk + 1) * Chunk::CHUNK_SIZE)));
-    }
-    // if we added a new chunk, edit the mesh
-    if (newChunks.size() > chunk_amount)
-    {
-        mesh.addChunksToMesh(newChunks); // we only want to call this once, we need to track size before and after insert
-    }
-    newChunks.clear();
-}
-
-Frustrum createFrustrumFromCamera(const Camera &camera, float aspect, float fovY, float zNear, float zFar)
-{
-    Frustrum frustrum;
-
-    // Far plane size
-    const float halfVSide = zFar * tanf(glm::radians(fovY) * 0.5f);
-    const float halfHSide = halfVSide * aspect;
-    const glm::vec3 frontMultFar = zFar * camera.Front;
-
-    // Near plane
-    glm::vec3 nearCenter = camera.Position + camera.Front * zNear;
-    frustrum.frontFace.normal = camera.Front;
-    frustrum.frontFace.distance = -glm::dot(frustrum.frontFace.normal, nearCenter);
-
-    // Far plane
-    glm::vec3 farCenter = camera.Position + frontMultFar;
-    frustrum.rearFace.normal = -camera.Front;
-    frustrum.rearFace.distance = -glm::dot(frustrum.rearFace.normal, farCenter);
-
-    // Right plane
-    glm::vec3 rightPoint = camera.Position + frontMultFar - camera.Right * halfHSide;
-    glm::vec3 rightNormal = glm::normalize(glm::cross(camera.Up, rightPoint - camera.Position));
-    frustrum.rightFace.normal = rightNormal;
-    frustrum.rightFace.distance = -glm::dot(rightNormal, camera.Position);
-
-    // Left plane
-    glm::vec3 leftPoint = camera.Position + frontMultFar + camera.Right * halfHSide;
-    glm::vec3 leftNormal = glm::normalize(glm::cross(leftPoint - camera.Position, camera.Up));
-    frustrum.leftFace.normal = leftNormal;
-    frustrum.leftFace.distance = -glm::dot(leftNormal, camera.Position);
-
-    // Top plane
-    glm::vec3 topPoint = camera.Position + frontMultFar - camera.Up * halfVSide;
-    glm::vec3 topNormal = glm::normalize(glm::cross(camera.Right, topPoint - camera.Position));
-    frustrum.topFace.normal = topNormal;
-    frustrum.topFace.distance = -glm::dot(topNormal, camera.Position);
-
-    // Bottom plane
-    glm::vec3 bottomPoint = camera.Position + frontMultFar + camera.Up * halfVSide;
-    glm::vec3 bottomNormal = glm::normalize(glm::cross(bottomPoint - camera.Position, camera.Right));
-    frustrum.bottomFace.normal = bottomNormal;
-    frustrum.bottomFace.distance = -glm::dot(bottomNormal, camera.Position);
-
-    return frustrum;
-}
-
-bool isCubeInFrustrum(const Frustrum &frustum, const glm::vec3 &center, float radius)
+void printArenaStats(const InstanceArenaStats &stats)
 {
-    Plane planes[6] = {
-        frustum.frontFace,
-        frustum.rearFace,
-        frustum.leftFace,
-        frustum.rightFace,
-        frustum.topFace,
-        frustum.bottomFace};
-
-    for (int i = 0; i < 6; i++)
-    {
-        // Dot product to check distance from the plane
-        float distance = glm::dot(planes[i].normal, center) + planes[i].distance;
-        if (distance < -radius)
-        {
-            // The cube is completely outside this plane
-            return false;
-        }
-    }
-    return true;
+    cout << "Instance arena: " << stats.slabs << " slabs, " << (stats.bytes() >> 20) << " MB, " << (int)(stats.occupancy() * 100.0f) << "% used, "
+         << (int)(stats.fragmentation() * 100.0f) << "% of the free space outside the largest hole (" << stats.holes << " holes)\n";
 }
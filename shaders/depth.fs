@@ -0,0 +1,14 @@
+#version 330 core
+
+in vec2 TexCoord;
+flat in float Layer;
+
+uniform sampler2DArray blockTextures;
+
+// depth pre-pass of the opaque chunks with texture.vs. only the depth test and write matter, but cut out texels of
+// opaque blocks (the tree block has some) are discarded like in texture.fs so they do not hide what is behind them
+void main()
+{
+        if (texture(blockTextures, vec3(TexCoord, Layer)).a < 0.1)
+                discard;
+}
@@ -3,11 +3,19 @@ layout (location = 0) in vec3 aPos;
 
 out vec3 TexCoords;
 
-uniform mat4 projection;
-uniform mat4 view;
+// per frame camera and light, see FrameData in frame_uniforms.h
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 skyboxViewProjection;
+    vec4 cameraPosition;
+    vec4 light;
+};
 
 void main()
 {
     TexCoords = aPos;
-    gl_Position = projection * view * vec4(aPos, 1.0);
+    gl_Position = skyboxViewProjection * vec4(aPos, 1.0);
 }  
\ No newline at end of file
@@ -2,35 +2,18 @@
 out vec4 FragColor;
 
 in vec2 TexCoord;
-in vec3 Normal;
-in vec3 FragPos;
+flat in float Layer;
+in float Shade;
 
-uniform sampler2D textureSide;
-uniform sampler2D textureTop;
-uniform sampler2D textureBottom;
-
-uniform vec3 lightColor;
-uniform vec3 lightPos;
+uniform sampler2DArray blockTextures;
 
 void main()
 {       
-        vec4 texColor = texture(textureSide, TexCoord);
+        vec4 texColor = texture(blockTextures, vec3(TexCoord, Layer));
 
         if (texColor.a < 0.1)
                 discard;
-        // ambient
-        float ambientStrength = 0.3f;
-        vec3 ambient = ambientStrength * lightColor;
-
-        // diffuse
-        vec3 norm = normalize(Normal);
-        vec3 lightDir = normalize(lightPos - FragPos);
-        float diff = max(dot(norm, lightDir), 0.0);
-        vec3 diffuse = diff * lightColor;
-
-        vec3 lighting = ambient + diffuse;
-
-        vec4 result = vec4(lighting * texColor.rgb, texColor.a);
 
-        FragColor = result;
+        // ambient, diffuse and ambient occlusion are baked into the mesh per corner
+        FragColor = vec4(Shade * texColor.rgb, texColor.a);
 }
\ No newline at end of file
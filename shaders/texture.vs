@@ -1,27 +1,67 @@
 #version 330 core
-layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec2 aTexCoord;
-layout (location = 2) in vec3 aNormal; 
-
-// Per-instance Model Matrix
-layout (location = 3) in mat4 aInstanceModel;
+// Per-instance packed face, see FaceInstance in chunk_mesher.h
+// 5 bits x, 5 bits z, 6 bits y, 5 bits width - 1, 6 bits height - 1, 3 bits face, 2 bits level of detail
+layout (location = 3) in uint aQuad;
+// 8 bits baked light, 8 bits corner occlusion, 6 bits texture layer, 10 bits chunk slot
+layout (location = 4) in uint aLight;
 
 out vec2 TexCoord;
-out vec3 Normal;
-out vec3 FragPos;
+flat out float Layer;
+out float Shade;
+// the depth pre-pass uses this shader with depth.fs, its depths must match the color pass exactly
+invariant gl_Position;
+
+// per frame camera and light, see FrameData in frame_uniforms.h
+layout (std140) uniform FrameData
+{
+    mat4 view;
+    mat4 projection;
+    mat4 viewProjection;
+    mat4 skyboxViewProjection;
+    vec4 cameraPosition;
+    vec4 light;
+};
+// world position of every chunk slot, instances are relative to their chunk
+uniform samplerBuffer chunkOrigins;
 
-uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+// must match SHADE_RANGE, AO_BRIGHTNESS and MESH_PADDING in the mesher headers
+const float shadeRange = 1.5;
+const float aoBrightness[4] = float[4](0.5, 0.7, 0.85, 1.0);
+const float meshPadding = 4.0;
+
+// normal, u and v axis of every face, like FACE_AXES in binary_mesher.h
+const vec3 faceNormal[6] = vec3[6](vec3(0, 0, -1), vec3(0, 0, 1), vec3(-1, 0, 0), vec3(1, 0, 0), vec3(0, -1, 0), vec3(0, 1, 0));
+const vec3 faceU[6] = vec3[6](vec3(1, 0, 0), vec3(1, 0, 0), vec3(0, 0, 1), vec3(0, 0, 1), vec3(1, 0, 0), vec3(1, 0, 0));
+const vec3 faceV[6] = vec3[6](vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 1, 0), vec3(0, 0, 1), vec3(0, 0, 1));
+// corners of the 2 triangles of a face in u, v. faces whose u x v points away from the normal take them in the
+// mirrored order so every face stays counter clockwise from the outside
+const vec2 quadCorners[6] = vec2[6](vec2(0, 0), vec2(1, 0), vec2(1, 1), vec2(1, 1), vec2(0, 1), vec2(0, 0));
+const vec2 mirroredCorners[6] = vec2[6](vec2(0, 0), vec2(0, 1), vec2(1, 1), vec2(1, 1), vec2(1, 0), vec2(0, 0));
 
 void main()
     {
-      // calculate world position for fragment shader
-      gl_Position = projection * view * aInstanceModel * vec4(aPos, 1.0);
-      FragPos = vec3(aInstanceModel * vec4(aPos, 1.0));
-
-      // calculate world-space normal for fragment shader
-      Normal = mat3(aInstanceModel) * aNormal;
-      
-      TexCoord = aTexCoord;
+      vec3 firstBlock = vec3(float(aQuad & 31u), float((aQuad >> 10u) & 63u), float((aQuad >> 5u) & 31u)) - vec3(meshPadding, 0.0, meshPadding);
+      vec2 size = vec2(float((aQuad >> 16u) & 31u) + 1.0, float((aQuad >> 21u) & 63u) + 1.0);
+      int face = int((aQuad >> 27u) & 7u);
+      // a face of a coarse mesh closes off cells of thickness blocks, its far side sits that much further out
+      float thickness = float(1u << (aQuad >> 30u));
+
+      vec3 normal = faceNormal[face];
+      vec3 u = faceU[face];
+      vec3 v = faceV[face];
+      vec2 corner = dot(cross(u, v), normal) > 0.0 ? quadCorners[gl_VertexID] : mirroredCorners[gl_VertexID];
+
+      // blocks are centered on their positions, the face spans size blocks along u and v
+      vec3 chunkOrigin = texelFetch(chunkOrigins, int(aLight >> 22u)).xyz;
+      vec3 worldPos = chunkOrigin + firstBlock + normal * 0.5 + max(normal, vec3(0.0)) * (thickness - 1.0) + u * (corner.x * size.x - 0.5) + v * (corner.y * size.y - 0.5);
+      gl_Position = viewProjection * vec4(worldPos, 1.0);
+
+      // corner i of the face sits at u = i & 1, v = i >> 1
+      int cornerIndex = int(corner.x) + 2 * int(corner.y);
+      uint ao = (aLight >> (8u + 2u * uint(cornerIndex))) & 3u;
+      Shade = float(aLight & 255u) / 255.0 * shadeRange * aoBrightness[ao];
+
+      // repeat the texture once per block across merged faces
+      TexCoord = corner * size;
+      Layer = float((aLight >> 16u) & 63u);
     }
\ No newline at end of file
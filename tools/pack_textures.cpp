@@ -0,0 +1,27 @@
+/**
+ * Texture pack builder
+ *
+ * Decodes the block textures and the skybox faces, computes the block textures' mip chain and writes everything as
+ * raw RGBA texels to graphics/textures.pack, which the game maps into memory at startup instead of decoding PNGs.
+ * Run it again after changing any texture, the game falls back to the PNGs while the pack is older than them.
+ *
+ * build and run from the repository root:
+ *   clang++ -std=c++17 -O2 -DGLFW_INCLUDE_NONE -Idependencies/include tools/pack_textures.cpp -o pack_textures -pthread
+ *   ./pack_textures
+ */
+
+#define STB_IMAGE_IMPLEMENTATION
+#include <chrono>
+#include "../headers/texture_pack.h"
+
+int main(int argc, char **argv)
+{
+    std::string path = argc > 1 ? argv[1] : TEXTURE_PACK_PATH;
+    auto start = std::chrono::steady_clock::now();
+    if (!writeTexturePack(path))
+    {
+        return 1;
+    }
+    printf("packed in %.1f ms\n", std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count());
+    return 0;
+}